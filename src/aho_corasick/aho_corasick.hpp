@@ -28,11 +28,31 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <queue>
 #include <utility>
 #include <vector>
 #include <limits>
+#include <new>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <iterator>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace aho_corasick {
 
@@ -254,8 +274,45 @@ namespace aho_corasick {
 		string_type get_keyword() const { return string_type(d_keyword); }
 		unsigned get_index() const { return d_index; }
 		bool is_empty() const { return (get_start() == -1 && get_end() == -1); }
+
+		// Orders by start, then keyword index, so that different keywords
+		// found at the same position are kept apart in an emit_collection.
+		bool operator <(const emit& other) const {
+			return get_start() < other.get_start()
+				|| (get_start() == other.get_start() && d_index < other.d_index);
+		}
+	};
+
+	// class match_result
+	//
+	// A match reported by keyword index and span only. Unlike emit it holds
+	// no copy of the keyword, so collecting one never allocates.
+	struct match_result {
+		unsigned index;
+		size_t   start;
+		size_t   end;
 	};
 
+	// Calls handler(index, start, end) for a match and reports whether the
+	// handler asked to stop: a handler may return nothing, or a value that
+	// converts to true to stop scanning.
+	template<typename Handler>
+	bool call_match_handler(Handler& handler, unsigned index, size_t start, size_t end, std::true_type /* returns void */) {
+		handler(index, start, end);
+		return false;
+	}
+
+	template<typename Handler>
+	bool call_match_handler(Handler& handler, unsigned index, size_t start, size_t end, std::false_type) {
+		return static_cast<bool>(handler(index, start, end));
+	}
+
+	template<typename Handler>
+	bool call_match_handler(Handler& handler, unsigned index, size_t start, size_t end) {
+		typedef decltype(handler(index, start, end)) result_type;
+		return call_match_handler(handler, index, start, end, std::is_void<result_type>());
+	}
+
 	// class token
 	template<typename CharType>
 	class token {
@@ -290,331 +347,3890 @@ namespace aho_corasick {
 		emit_type get_emit() const { return d_emit; }
 	};
 
-	// class state
-	template<typename CharType>
-	class state {
+	// class arena
+	//
+	// Bump allocator carving memory out of a handful of large blocks. Single
+	// deallocations are no-ops; everything is handed back at once when the
+	// arena is destroyed.
+	class arena {
+		enum : size_t {
+			initial_block_size = 4096,
+			max_block_size     = 16 * 1024 * 1024,
+		};
+
+		std::vector<std::unique_ptr<char[]>> d_blocks;
+		char*                                d_cur;
+		size_t                               d_left;
+		size_t                               d_next_block_size;
+
 	public:
-    typedef CharType                         type;
-		typedef state<CharType>*                 ptr;
-		typedef std::unique_ptr<state<CharType>> unique_ptr;
-		typedef std::basic_string<CharType>      string_type;
-		typedef std::basic_string<CharType>&     string_ref_type;
-		typedef std::pair<string_type, unsigned> key_index;
-		typedef std::set<key_index>              string_collection;
-		typedef std::vector<ptr>                 state_collection;
-		typedef std::vector<CharType>            transition_collection;
+		arena()
+			: d_blocks()
+			, d_cur(nullptr)
+			, d_left(0)
+			, d_next_block_size(initial_block_size) {}
+
+		arena(const arena&) = delete;
+		arena& operator=(const arena&) = delete;
+
+		void* allocate(size_t bytes, size_t alignment) {
+			size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(d_cur) % alignment) % alignment;
+			if (d_cur == nullptr || padding + bytes > d_left) {
+				add_block(bytes + alignment);
+				padding = (alignment - reinterpret_cast<std::uintptr_t>(d_cur) % alignment) % alignment;
+			}
+			char* result = d_cur + padding;
+			d_cur += padding + bytes;
+			d_left -= padding + bytes;
+			return result;
+		}
+
+		size_t num_blocks() const { return d_blocks.size(); }
 
 	private:
-		size_t                         d_depth;
-		ptr                            d_root;
-		std::map<CharType, unique_ptr> d_success;
-    bool                           d_has_success;
-    ptr                            d_failure;
-    string_collection              d_emits;
-    type                           d_value; // used for matching against +/#
-    bool                           d_ending_pattern;
+		void add_block(size_t min_size) {
+			size_t size = std::max<size_t>(d_next_block_size, min_size);
+			d_blocks.emplace_back(new char[size]);
+			d_cur = d_blocks.back().get();
+			d_left = size;
+			d_next_block_size = std::min<size_t>(d_next_block_size * 2, max_block_size);
+		}
+	};
+
+	// class arena_allocator
+	template<typename T>
+	class arena_allocator {
+		template<typename U> friend class arena_allocator;
+
+		arena* d_arena;
 
 	public:
-		state(): state(0, 0) {}
+		typedef T value_type;
 
-		explicit state(size_t depth, type val)
-			: d_depth(depth)
-			, d_root(depth == 0 ? this : nullptr)
-			, d_success()
-			, d_failure(nullptr)
-			, d_emits()
-      , d_value(val)
-      , d_has_success(false)
-      {}
+		explicit arena_allocator(arena* a)
+			: d_arena(a) {}
 
-		ptr next_state(CharType character) const {
-			return next_state(character, false, false);
-		}
+		template<typename U>
+		arena_allocator(const arena_allocator<U>& other)
+			: d_arena(other.d_arena) {}
 
-		ptr next_state_ignore_root_state(CharType character) const {
-			return next_state(character, true, true);
+		T* allocate(size_t n) {
+			return static_cast<T*>(d_arena->allocate(n * sizeof(T), alignof(T)));
 		}
 
-		ptr add_state(CharType character) {
-			auto next = next_state_ignore_root_state(character);
-			if (next == nullptr) {
-				next = new state<CharType>(d_depth + 1, character);
-				d_success[character].reset(next);
-        if (next != this)
-          d_has_success = true;
+		void deallocate(T*, size_t) {}
+
+		template<typename U>
+		bool operator ==(const arena_allocator<U>& other) const { return d_arena == other.d_arena; }
+
+		template<typename U>
+		bool operator !=(const arena_allocator<U>& other) const { return d_arena != other.d_arena; }
+	};
+
+	// class object_pool
+	//
+	// Hands out objects of one type from slabs of geometrically growing size.
+	// Destruction runs every destructor in one linear pass over the slabs and
+	// then frees the slabs, so tearing down a deep trie never recurses.
+	template<typename T>
+	class object_pool {
+		typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type slot;
+
+		enum : size_t {
+			initial_slab_size = 64,
+			max_slab_size     = 64 * 1024,
+		};
+
+		std::vector<std::unique_ptr<slot[]>> d_slabs;
+		std::vector<size_t>                  d_slab_sizes;
+		size_t                               d_used;
+
+	public:
+		object_pool()
+			: d_slabs()
+			, d_slab_sizes()
+			, d_used(0) {}
+
+		object_pool(const object_pool&) = delete;
+		object_pool& operator=(const object_pool&) = delete;
+
+		~object_pool() {
+			for (size_t i = 0; i < d_slabs.size(); ++i) {
+				size_t used = (i + 1 == d_slabs.size()) ? d_used : d_slab_sizes[i];
+				T* objects = reinterpret_cast<T*>(d_slabs[i].get());
+				for (size_t j = 0; j < used; ++j) {
+					objects[j].~T();
+				}
 			}
-			return next;
 		}
 
-		ptr add_state(CharType character, ptr state) {
-			auto next = next_state_ignore_root_state(character);
-			if (next == nullptr) {
-				d_success[character].reset(state);
-        if (state != this)
-          d_has_success = true;
-      }
-			return state;
+		template<typename... Args>
+		T* create(Args&&... args) {
+			if (d_slabs.empty() || d_used == d_slab_sizes.back()) {
+				size_t size = d_slabs.empty() ? initial_slab_size : std::min<size_t>(d_slab_sizes.back() * 2, max_slab_size);
+				d_slabs.emplace_back(new slot[size]);
+				d_slab_sizes.push_back(size);
+				d_used = 0;
+			}
+			T* result = new (&d_slabs.back()[d_used]) T(std::forward<Args>(args)...);
+			++d_used;
+			return result;
 		}
+	};
 
-		size_t get_depth() const { return d_depth; }
+	// class sparse_set
+	//
+	// Briggs-Torczon sparse set over the integers [0, capacity): insert, test
+	// and clear are O(1) and iteration follows insertion order. Clearing only
+	// resets the size; stale d_sparse entries are harmless because membership
+	// is confirmed through d_dense, so one set serves any number of matches
+	// without being re-initialised.
+	class sparse_set {
+		std::vector<std::uint32_t> d_dense;
+		std::vector<std::uint32_t> d_sparse;
+		std::uint32_t              d_size;
 
-		void add_emit(string_ref_type keyword, unsigned index) {
-			d_emits.insert(std::make_pair(keyword, index));
-		}
+	public:
+		typedef const std::uint32_t* const_iterator;
 
-		void add_emit(const string_collection& emits) {
-			for (const auto& e : emits) {
-				string_type str(e.first);
-				add_emit(str, e.second);
+		explicit sparse_set(size_t capacity = 0)
+			: d_dense(capacity)
+			, d_sparse(capacity)
+			, d_size(0) {}
+
+		size_t capacity() const { return d_sparse.size(); }
+		size_t size() const { return d_size; }
+		bool empty() const { return d_size == 0; }
+
+		// Grows the universe; existing members are kept.
+		void reserve(size_t capacity) {
+			if (capacity > d_sparse.size()) {
+				d_dense.resize(capacity);
+				d_sparse.resize(capacity);
 			}
 		}
 
-		string_collection get_emits() const { return d_emits; }
+		bool contains(std::uint32_t value) const {
+			std::uint32_t index = d_sparse[value];
+			return index < d_size && d_dense[index] == value;
+		}
 
-    bool ending_pattern() { return d_ending_pattern; }
+		// Returns false if value was already a member.
+		bool insert(std::uint32_t value) {
+			if (contains(value)) {
+				return false;
+			}
+			d_sparse[value] = d_size;
+			d_dense[d_size++] = value;
+			return true;
+		}
 
-    void set_ending_pattern(bool ending_pattern) { d_ending_pattern = ending_pattern; }
+		void clear() { d_size = 0; }
 
-    CharType value() { return d_value; }
+		const_iterator begin() const { return d_dense.data(); }
+		const_iterator end() const { return d_dense.data() + d_size; }
+	};
 
-		ptr failure() const { return d_failure; }
+	// class byte_classes
+	//
+	// Partitions the 256 byte values into equivalence classes so transition
+	// tables can be indexed by class instead of by byte. Every byte occurring
+	// in a pattern gets a class of its own; all the others share class 0, as
+	// no transition can tell them apart.
+	class byte_classes {
+		std::uint16_t d_classes[256];
+		unsigned      d_num_classes;
 
-		void set_failure(ptr fail_state) { d_failure = fail_state; }
+	public:
+		byte_classes()
+			: d_num_classes(1)
+		{
+			std::fill(d_classes, d_classes + 256, std::uint16_t(0));
+		}
 
-    bool has_success() const {return d_has_success;}
+		unsigned num_classes() const { return d_num_classes; }
 
-		state_collection get_states() const {
-			state_collection result;
-			for (auto it = d_success.cbegin(); it != d_success.cend(); ++it) {
-				result.push_back(it->second.get());
+		unsigned get(unsigned char c) const { return d_classes[c]; }
+
+		// Gives c a class of its own, unless it has one already.
+		void add(unsigned char c) {
+			if (d_classes[c] == 0) {
+				d_classes[c] = static_cast<std::uint16_t>(d_num_classes++);
 			}
-			return state_collection(result);
 		}
 
-		transition_collection get_transitions() const {
-			transition_collection result;
-			for (auto it = d_success.cbegin(); it != d_success.cend(); ++it) {
-				result.push_back(it->first);
-			}
-			return transition_collection(result);
+		// Puts c in the class of other, for folding case.
+		void alias(unsigned char c, unsigned char other) {
+			d_classes[c] = d_classes[other];
 		}
+	};
 
-	private:
-		ptr next_state(CharType character, bool ignore_root_state, bool state_insertion) const {
-      ptr result = nullptr;
+	// Transition containers
+	//
+	// A state keeps its outgoing transitions in one of the containers below,
+	// chosen through the Transitions template parameter of state/basic_trie.
+	// Each takes the arena of its trie, maps a character to a Value (a state
+	// pointer) and reports a missing transition as Value(). A container with
+	// an (arena*, size_t) constructor also gets the depth of its state.
 
-      auto found = d_success.find(character);
-      if (found != d_success.end()) {
-        result = found->second.get();
-      }
+	// class map_transitions
+	template<typename CharType, typename Value>
+	class map_transitions {
+		typedef arena_allocator<std::pair<const CharType, Value>>               allocator_type;
+		typedef std::map<CharType, Value, std::less<CharType>, allocator_type> map_type;
 
-			return result;
-		}
-	};
+		map_type d_map;
 
-	template<typename CharType>
-	class basic_trie {
 	public:
-		using string_type = std::basic_string < CharType > ;
-		using string_ref_type = std::basic_string<CharType>&;
+		explicit map_transitions(arena* a)
+			: d_map(std::less<CharType>(), allocator_type(a)) {}
 
-		typedef state<CharType>         state_type;
-		typedef state<CharType>*        state_ptr_type;
-		typedef token<CharType>         token_type;
-		typedef emit<CharType>          emit_type;
-		typedef std::vector<state_ptr_type> state_collection;
-		typedef std::vector<token_type> token_collection;
-		typedef std::map<emit_type, bool>  emit_collection;
+		Value find(CharType character) const {
+			auto found = d_map.find(character);
+			return (found == d_map.end()) ? Value() : found->second;
+		}
 
-		class config {
-			bool d_case_insensitive;
+		void insert(CharType character, Value value) { d_map[character] = value; }
 
-		public:
-			config()
-				: d_case_insensitive(false) {}
+		size_t size() const { return d_map.size(); }
 
-			bool is_case_insensitive() const { return d_case_insensitive; }
-			void set_case_insensitive(bool val) { d_case_insensitive = val; }
+		template<typename Function>
+		void for_each(Function f) const {
+			for (const auto& transition : d_map) {
+				f(transition.first, transition.second);
+			}
+		}
+	};
+
+	// class sorted_vector_transitions
+	//
+	// Label-sorted array, scanned linearly while small and binary searched
+	// once it grows. Suits the long single-child chains of a topic trie.
+	template<typename CharType, typename Value>
+	class sorted_vector_transitions {
+		enum : std::uint32_t {
+			linear_search_limit = 8,
 		};
 
-	private:
-		std::unique_ptr<state_type> d_root;
-		config                      d_config;
-		bool                        d_constructed_failure_states;
-		unsigned                    d_num_keywords = 0;
+		struct entry {
+			CharType label;
+			Value    target;
+		};
+
+		arena*        d_arena;
+		entry*        d_entries;
+		std::uint32_t d_size;
+		std::uint32_t d_capacity;
 
 	public:
-		basic_trie(): basic_trie(config()) {}
+		explicit sorted_vector_transitions(arena* a)
+			: d_arena(a)
+			, d_entries(nullptr)
+			, d_size(0)
+			, d_capacity(0) {}
 
-		basic_trie(const config& c)
-			: d_root(new state_type())
-			, d_config(c)
-			, d_constructed_failure_states(false) {}
+		Value find(CharType character) const {
+			if (d_size <= linear_search_limit) {
+				for (std::uint32_t i = 0; i < d_size; ++i) {
+					if (d_entries[i].label == character) {
+						return d_entries[i].target;
+					}
+				}
+				return Value();
+			}
+			auto found = lower_bound(character);
+			return (found != d_entries + d_size && found->label == character) ? found->target : Value();
+		}
 
-		basic_trie& case_insensitive() {
-			d_config.set_case_insensitive(true);
-			return (*this);
+		void insert(CharType character, Value value) {
+			auto found = lower_bound(character);
+			if (found != d_entries + d_size && found->label == character) {
+				found->target = value;
+				return;
+			}
+			size_t index = found - d_entries;
+			if (d_size == d_capacity) {
+				d_capacity = (d_capacity == 0) ? 1 : d_capacity * 2;
+				auto grown = static_cast<entry*>(d_arena->allocate(d_capacity * sizeof(entry), alignof(entry)));
+				std::copy(d_entries, d_entries + d_size, grown);
+				d_entries = grown;
+			}
+			std::copy_backward(d_entries + index, d_entries + d_size, d_entries + d_size + 1);
+			d_entries[index].label = character;
+			d_entries[index].target = value;
+			++d_size;
 		}
 
-		basic_trie& remove_overlaps() {
-			d_config.set_allow_overlaps(false);
-			return (*this);
+		size_t size() const { return d_size; }
+
+		template<typename Function>
+		void for_each(Function f) const {
+			for (std::uint32_t i = 0; i < d_size; ++i) {
+				f(d_entries[i].label, d_entries[i].target);
+			}
 		}
 
-		basic_trie& only_whole_words() {
-			d_config.set_only_whole_words(true);
-			return (*this);
+	private:
+		entry* lower_bound(CharType character) const {
+			return std::lower_bound(d_entries, d_entries + d_size, character, [](const entry& e, CharType c) {
+				return e.label < c;
+			});
 		}
+	};
 
-		void insert(string_type keyword) {
-			if (keyword.empty())
-				return;
-			state_ptr_type cur_state = d_root.get();
-      state_ptr_type last_multi_wildcard = nullptr;
+	// class dense_transitions
+	//
+	// Direct 256-entry table for byte-sized characters. The table is only
+	// allocated once the first transition is added, so leaves stay small.
+	template<typename CharType, typename Value>
+	class dense_transitions {
+		static_assert(sizeof(CharType) == 1, "dense_transitions requires a byte-sized character type");
 
-			for (const auto& ch : keyword) {
-				cur_state = cur_state->add_state(ch);
+		enum : size_t {
+			table_size = 256,
+		};
 
-        // Of course! I know that handling failures this way, could bring some bugs for matching topics later,
-        // I'll be return and fix this section later...
-        // topics with multiple # and +s will have some problems because of this!
-        switch (ch) {
-          case '.':
-            if (last_multi_wildcard)
-              cur_state->set_failure(last_multi_wildcard);
-            break;
-          case '+':
-            cur_state->add_state('+', cur_state);
-            break;
-          case '#':
-            cur_state->add_state('#', cur_state);
-            last_multi_wildcard = cur_state;
-            break;
-        }
-			}
+		arena* d_arena;
+		Value* d_table;
+		size_t d_size;
 
-      if (cur_state != d_root.get())
-        cur_state->set_ending_pattern(true);
+	public:
+		explicit dense_transitions(arena* a)
+			: d_arena(a)
+			, d_table(nullptr)
+			, d_size(0) {}
 
-			cur_state->add_emit(keyword, d_num_keywords++);
-			d_constructed_failure_states = false;
+		Value find(CharType character) const {
+			return (d_table == nullptr) ? Value() : d_table[static_cast<unsigned char>(character)];
 		}
 
-		template<class InputIterator>
-		void insert(InputIterator first, InputIterator last) {
-			for (InputIterator it = first; first != last; ++it) {
-				insert(*it);
+		void insert(CharType character, Value value) {
+			if (d_table == nullptr) {
+				d_table = static_cast<Value*>(d_arena->allocate(table_size * sizeof(Value), alignof(Value)));
+				std::fill(d_table, d_table + table_size, Value());
 			}
+			Value& slot = d_table[static_cast<unsigned char>(character)];
+			if (slot == Value()) {
+				++d_size;
+			}
+			slot = value;
 		}
 
-		token_collection tokenise(string_type text) {
-			token_collection tokens;
-			auto collected_emits = parse_text(text);
-			size_t last_pos = -1;
-			for (const auto& e : collected_emits) {
-				if (e.get_start() - last_pos > 1) {
-					tokens.push_back(create_fragment(e, text, last_pos));
-				}
-				tokens.push_back(create_match(e, text));
-				last_pos = e.get_end();
+		size_t size() const { return d_size; }
+
+		template<typename Function>
+		void for_each(Function f) const {
+			if (d_table == nullptr) {
+				return;
 			}
-			if (text.size() - last_pos > 1) {
-				tokens.push_back(create_fragment(typename token_type::emit_type(), text, last_pos));
+			for (size_t i = 0; i < table_size; ++i) {
+				if (d_table[i] != Value()) {
+					f(static_cast<CharType>(i), d_table[i]);
+				}
 			}
-			return token_collection(tokens);
 		}
+	};
 
-		emit_collection parse_text(string_type text) {
-			size_t pos = 0;
-			emit_collection collected_emits;
+	// class hash_transitions
+	//
+	// Open-addressing table with linear probing, kept at most 3/4 full. Meant
+	// for wide character types where a direct table would be far too big.
+	template<typename CharType, typename Value>
+	class hash_transitions {
+		struct entry {
+			CharType label;
+			Value    target;   // Value() marks an empty slot
+		};
 
-      state_collection prev_states;
-      state_collection cur_states;
-      prev_states.reserve(32);
-      cur_states.reserve(32);
-      prev_states.push_back(d_root.get());
+		arena*        d_arena;
+		entry*        d_slots;
+		std::uint32_t d_size;
+		std::uint32_t d_capacity;
 
-      for (auto c : text) {
-				if (d_config.is_case_insensitive()) {
-					c = std::tolower(c);
-				}
+	public:
+		explicit hash_transitions(arena* a)
+			: d_arena(a)
+			, d_slots(nullptr)
+			, d_size(0)
+			, d_capacity(0) {}
 
-        for (auto& cur_state: prev_states)
-        {
-          auto state = get_state(cur_state, c);
-          if (state)
-          {
-            if (!state->has_success() && pos + 1 == text.length())  // state finished
-              store_emits(pos, state, collected_emits);
-            cur_states.push_back(state);
-          }
+		Value find(CharType character) const {
+			if (d_capacity == 0) {
+				return Value();
+			}
+			std::uint32_t mask = d_capacity - 1;
+			for (std::uint32_t i = hash(character) & mask; ; i = (i + 1) & mask) {
+				if (d_slots[i].target == Value()) {
+					return Value();
+				}
+				if (d_slots[i].label == character) {
+					return d_slots[i].target;
+				}
+			}
+		}
 
-          if (!(cur_state->value() == '+' && c == '.')) {
-            state = get_state(cur_state, '+');
-            if (state) {
-              if ((!state->has_success() || state->ending_pattern()) && pos + 1 == text.length())  // state finished
-                store_emits(pos, state, collected_emits);
-              cur_states.push_back(state);
-            }
-          }
+		void insert(CharType character, Value value) {
+			if ((d_size + 1) * 4 > d_capacity * 3) {
+				rehash((d_capacity == 0) ? 4 : d_capacity * 2);
+			}
+			if (place(d_slots, d_capacity, character, value)) {
+				++d_size;
+			}
+		}
 
-          state = get_state(cur_state, '#');
-          if (state)
-          {
-            if ((!state->has_success() || state->ending_pattern()) && pos + 1 == text.length())  // state finished
-              store_emits(pos, state, collected_emits);
-            cur_states.push_back(state);
-          }
-        }
+		size_t size() const { return d_size; }
 
-        prev_states = std::move(cur_states);
-        pos++;
+		template<typename Function>
+		void for_each(Function f) const {
+			for (std::uint32_t i = 0; i < d_capacity; ++i) {
+				if (d_slots[i].target != Value()) {
+					f(d_slots[i].label, d_slots[i].target);
+				}
 			}
-			return emit_collection(collected_emits);
 		}
 
 	private:
-		token_type create_fragment(const typename token_type::emit_type& e, string_ref_type text, size_t last_pos) const {
-			auto start = last_pos + 1;
-			auto end = (e.is_empty()) ? text.size() : e.get_start();
-			auto len = end - start;
-			typename token_type::string_type str(text.substr(start, len));
-			return token_type(str);
-		}
-
-		token_type create_match(const typename token_type::emit_type& e, string_ref_type text) const {
-			auto start = e.get_start();
-			auto end = e.get_end() + 1;
-			auto len = end - start;
-			typename token_type::string_type str(text.substr(start, len));
-			return token_type(str, e);
+		static std::uint32_t hash(CharType character) {
+			return static_cast<std::uint32_t>(character) * 2654435761u >> 7;
 		}
 
-		state_ptr_type get_state(state_ptr_type cur_state, CharType c) const {
-			state_ptr_type result = cur_state->next_state(c);
-			while (result == nullptr) {
-				cur_state = cur_state->failure();
-        if (cur_state == nullptr)
-          break;
-				result = cur_state->next_state(c);
+		// returns true when a new slot was taken, false when value replaced one
+		static bool place(entry* slots, std::uint32_t capacity, CharType character, Value value) {
+			std::uint32_t mask = capacity - 1;
+			for (std::uint32_t i = hash(character) & mask; ; i = (i + 1) & mask) {
+				if (slots[i].target == Value()) {
+					slots[i].label = character;
+					slots[i].target = value;
+					return true;
+				}
+				if (slots[i].label == character) {
+					slots[i].target = value;
+					return false;
+				}
 			}
-			return result;
 		}
 
-		void store_emits(size_t pos, state_ptr_type cur_state, emit_collection& collected_emits) const {
-			auto emits = cur_state->get_emits();
-			if (!emits.empty()) {
-				for (const auto& str : emits) {
-					auto emit_str = typename emit_type::string_type(str.first);
-					collected_emits[emit_type(pos - emit_str.size() + 1, pos, emit_str, str.second)] = true;
+		void rehash(std::uint32_t capacity) {
+			auto slots = static_cast<entry*>(d_arena->allocate(capacity * sizeof(entry), alignof(entry)));
+			for (std::uint32_t i = 0; i < capacity; ++i) {
+				slots[i].target = Value();
+			}
+			for (std::uint32_t i = 0; i < d_capacity; ++i) {
+				if (d_slots[i].target != Value()) {
+					place(slots, capacity, d_slots[i].label, d_slots[i].target);
 				}
 			}
+			d_slots = slots;
+			d_capacity = capacity;
+		}
+	};
+
+	// class adaptive_transitions
+	//
+	// Adaptive Radix Tree style container for byte-sized characters. It starts
+	// as an inline 4-way node and grows into 16-way (SSE2 searched), 48-way
+	// (byte index into 48 slots) and finally direct 256-way nodes as children
+	// are added, so the long single-child chains of a topic trie stay small
+	// while the wide root still resolves in one lookup.
+	template<typename CharType, typename Value>
+	class adaptive_transitions {
+		static_assert(sizeof(CharType) == 1, "adaptive_transitions requires a byte-sized character type");
+
+		enum node_kind : std::uint8_t {
+			NODE_4,
+			NODE_16,
+			NODE_48,
+			NODE_256,
+		};
+
+		struct node_16 {
+			CharType keys[16];
+			Value    values[16];
+		};
+
+		struct node_48 {
+			std::uint8_t index[256];   // slot + 1, 0 when absent
+			Value        values[48];
+		};
+
+		struct node_256 {
+			Value values[256];
+		};
+
+		arena*        d_arena;
+		node_kind     d_kind;
+		std::uint16_t d_size;
+		CharType      d_keys[4];       // NODE_4 only
+		union {
+			Value     d_values[4];     // NODE_4 only
+			node_16*  d_node_16;
+			node_48*  d_node_48;
+			node_256* d_node_256;
+		};
+
+	public:
+		explicit adaptive_transitions(arena* a)
+			: d_arena(a)
+			, d_kind(NODE_4)
+			, d_size(0)
+		{
+			std::fill(d_values, d_values + 4, Value());
+		}
+
+		Value find(CharType character) const {
+			switch (d_kind) {
+			case NODE_4:
+				for (std::uint16_t i = 0; i < d_size; ++i) {
+					if (d_keys[i] == character) {
+						return d_values[i];
+					}
+				}
+				return Value();
+			case NODE_16: {
+				int i = find_16(d_node_16->keys, character);
+				return (i < 0) ? Value() : d_node_16->values[i];
+			}
+			case NODE_48: {
+				std::uint8_t slot = d_node_48->index[static_cast<unsigned char>(character)];
+				return (slot == 0) ? Value() : d_node_48->values[slot - 1];
+			}
+			case NODE_256:
+				return d_node_256->values[static_cast<unsigned char>(character)];
+			}
+			return Value();
+		}
+
+		void insert(CharType character, Value value) {
+			if (replace(character, value)) {
+				return;
+			}
+			switch (d_kind) {
+			case NODE_4:
+				if (d_size < 4) {
+					d_keys[d_size] = character;
+					d_values[d_size] = value;
+					break;
+				}
+				grow_to_16();
+				// fall through
+			case NODE_16:
+				if (d_size < 16) {
+					d_node_16->keys[d_size] = character;
+					d_node_16->values[d_size] = value;
+					break;
+				}
+				grow_to_48();
+				// fall through
+			case NODE_48:
+				if (d_size < 48) {
+					d_node_48->values[d_size] = value;
+					d_node_48->index[static_cast<unsigned char>(character)] = static_cast<std::uint8_t>(d_size + 1);
+					break;
+				}
+				grow_to_256();
+				// fall through
+			case NODE_256:
+				d_node_256->values[static_cast<unsigned char>(character)] = value;
+				break;
+			}
+			++d_size;
+		}
+
+		size_t size() const { return d_size; }
+
+		template<typename Function>
+		void for_each(Function f) const {
+			switch (d_kind) {
+			case NODE_4:
+				for (std::uint16_t i = 0; i < d_size; ++i) {
+					f(d_keys[i], d_values[i]);
+				}
+				break;
+			case NODE_16:
+				for (std::uint16_t i = 0; i < d_size; ++i) {
+					f(d_node_16->keys[i], d_node_16->values[i]);
+				}
+				break;
+			case NODE_48:
+				for (size_t c = 0; c < 256; ++c) {
+					if (d_node_48->index[c] != 0) {
+						f(static_cast<CharType>(c), d_node_48->values[d_node_48->index[c] - 1]);
+					}
+				}
+				break;
+			case NODE_256:
+				for (size_t c = 0; c < 256; ++c) {
+					if (d_node_256->values[c] != Value()) {
+						f(static_cast<CharType>(c), d_node_256->values[c]);
+					}
+				}
+				break;
+			}
+		}
+
+	private:
+		int find_16(const CharType* keys, CharType character) const {
+#if defined(__SSE2__)
+			__m128i needle = _mm_set1_epi8(static_cast<char>(character));
+			__m128i haystack = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(needle, haystack)) & ((1 << d_size) - 1);
+			return (mask == 0) ? -1 : __builtin_ctz(mask);
+#else
+			for (std::uint16_t i = 0; i < d_size; ++i) {
+				if (keys[i] == character) {
+					return i;
+				}
+			}
+			return -1;
+#endif
+		}
+
+		bool replace(CharType character, Value value) {
+			switch (d_kind) {
+			case NODE_4:
+				for (std::uint16_t i = 0; i < d_size; ++i) {
+					if (d_keys[i] == character) {
+						d_values[i] = value;
+						return true;
+					}
+				}
+				return false;
+			case NODE_16: {
+				int i = find_16(d_node_16->keys, character);
+				if (i >= 0) {
+					d_node_16->values[i] = value;
+				}
+				return i >= 0;
+			}
+			case NODE_48: {
+				std::uint8_t slot = d_node_48->index[static_cast<unsigned char>(character)];
+				if (slot != 0) {
+					d_node_48->values[slot - 1] = value;
+				}
+				return slot != 0;
+			}
+			case NODE_256: {
+				Value& slot = d_node_256->values[static_cast<unsigned char>(character)];
+				bool found = slot != Value();
+				if (found) {
+					slot = value;
+				}
+				return found;
+			}
+			}
+			return false;
+		}
+
+		template<typename Node>
+		Node* allocate_node() {
+			return static_cast<Node*>(d_arena->allocate(sizeof(Node), alignof(Node)));
+		}
+
+		void grow_to_16() {
+			auto grown = allocate_node<node_16>();
+			std::fill(grown->keys, grown->keys + 16, CharType());
+			std::copy(d_keys, d_keys + 4, grown->keys);
+			std::copy(d_values, d_values + 4, grown->values);
+			d_node_16 = grown;
+			d_kind = NODE_16;
+		}
+
+		void grow_to_48() {
+			auto grown = allocate_node<node_48>();
+			std::fill(grown->index, grown->index + 256, 0);
+			for (std::uint16_t i = 0; i < 16; ++i) {
+				grown->values[i] = d_node_16->values[i];
+				grown->index[static_cast<unsigned char>(d_node_16->keys[i])] = static_cast<std::uint8_t>(i + 1);
+			}
+			d_node_48 = grown;
+			d_kind = NODE_48;
+		}
+
+		void grow_to_256() {
+			auto grown = allocate_node<node_256>();
+			std::fill(grown->values, grown->values + 256, Value());
+			for (size_t c = 0; c < 256; ++c) {
+				if (d_node_48->index[c] != 0) {
+					grown->values[c] = d_node_48->values[d_node_48->index[c] - 1];
+				}
+			}
+			d_node_256 = grown;
+			d_kind = NODE_256;
+		}
+	};
+
+	// class leveled_transitions
+	//
+	// Direct 256-entry tables for the states above depth DenseLevels, which
+	// every match passes through, and adaptive_transitions below, where
+	// states are many, cold and mostly have a single child that fits its
+	// inline node. The tables are cache-line aligned and allocated up front;
+	// hybrid_transitions picks the depth.
+	template<typename CharType, typename Value, size_t DenseLevels>
+	class leveled_transitions {
+		static_assert(sizeof(CharType) == 1, "leveled_transitions requires a byte-sized character type");
+
+		enum : size_t {
+			table_size = 256,
+			cache_line = 64,
+		};
+
+		Value*                                 d_table;
+		adaptive_transitions<CharType, Value>  d_sparse;
+		size_t                                 d_size;
+
+	public:
+		leveled_transitions(arena* a, size_t depth)
+			: d_table(nullptr)
+			, d_sparse(a)
+			, d_size(0)
+		{
+			if (depth < DenseLevels) {
+				d_table = static_cast<Value*>(a->allocate(table_size * sizeof(Value), cache_line));
+				std::fill(d_table, d_table + table_size, Value());
+			}
+		}
+
+		Value find(CharType character) const {
+			if (d_table != nullptr) {
+				return d_table[static_cast<unsigned char>(character)];
+			}
+			return d_sparse.find(character);
+		}
+
+		void insert(CharType character, Value value) {
+			if (d_table == nullptr) {
+				d_sparse.insert(character, value);
+				return;
+			}
+			Value& slot = d_table[static_cast<unsigned char>(character)];
+			if (slot == Value()) {
+				++d_size;
+			}
+			slot = value;
+		}
+
+		size_t size() const { return (d_table != nullptr) ? d_size : d_sparse.size(); }
+
+		template<typename Function>
+		void for_each(Function f) const {
+			if (d_table == nullptr) {
+				d_sparse.for_each(f);
+				return;
+			}
+			for (size_t i = 0; i < table_size; ++i) {
+				if (d_table[i] != Value()) {
+					f(static_cast<CharType>(i), d_table[i]);
+				}
+			}
+		}
+	};
+
+	// The root and the level below it dense, the rest sparse.
+	template<typename CharType, typename Value>
+	using hybrid_transitions = leveled_transitions<CharType, Value, 2>;
+
+	template<typename Transitions>
+	typename std::enable_if<std::is_constructible<Transitions, arena*, size_t>::value, Transitions>::type
+	make_transitions(arena* a, size_t depth) {
+		return Transitions(a, depth);
+	}
+
+	template<typename Transitions>
+	typename std::enable_if<!std::is_constructible<Transitions, arena*, size_t>::value, Transitions>::type
+	make_transitions(arena* a, size_t) {
+		return Transitions(a);
+	}
+
+	// The next segment separator in [first, last), or last. Byte text goes
+	// through memchr, which the C library vectorises.
+	template<typename ForwardIterator>
+	ForwardIterator find_separator(ForwardIterator first, ForwardIterator last) {
+		return std::find(first, last, '.');
+	}
+
+	inline const char* find_separator(const char* first, const char* last) {
+		const void* found = std::memchr(first, '.', static_cast<size_t>(last - first));
+		return (found != nullptr) ? static_cast<const char*>(found) : last;
+	}
+
+	// Whether a keyword holds a '+' or '#' and so needs a wildcard automaton.
+	template<typename CharType>
+	bool has_wildcard(const std::basic_string<CharType>& keyword) {
+		for (CharType c : keyword) {
+			if (c == '+' || c == '#')
+				return true;
+		}
+		return false;
+	}
+
+	// class state
+	template<typename CharType, template<typename, typename> class Transitions = map_transitions>
+	class state {
+	public:
+    typedef CharType                         type;
+		typedef state*                           ptr;
+		typedef std::unique_ptr<state>           unique_ptr;
+		typedef std::basic_string<CharType>      string_type;
+		typedef std::basic_string<CharType>&     string_ref_type;
+		typedef std::pair<string_type, unsigned> key_index;
+		typedef std::set<key_index>              string_collection;
+		typedef std::vector<ptr>                 state_collection;
+		typedef std::vector<CharType>            transition_collection;
+
+	private:
+		typedef Transitions<CharType, ptr> success_collection;
+
+		struct storage;
+
+		std::unique_ptr<storage>       d_owned_storage;
+		storage*                       d_storage;
+		std::uint32_t                  d_id;
+		size_t                         d_depth;
+		ptr                            d_root;
+		success_collection             d_success;
+    bool                           d_has_success;
+    ptr                            d_failure;
+    ptr                            d_output;  // nearest failure ancestor with emits
+    string_collection              d_emits;
+    std::uint32_t                  d_first_emit;
+    std::uint32_t                  d_num_emits;
+    type                           d_value; // used for matching against +/#
+    bool                           d_ending_pattern;
+    bool                           d_skips_segment;
+    bool                           d_accepts_remainder;
+
+	public:
+		state(): state(0, 0) {}
+
+		explicit state(size_t depth, type val)
+			: state(depth, val, new storage(), true) {}
+
+		state(const state&) = delete;
+		state& operator=(const state&) = delete;
+
+		ptr next_state(CharType character) const {
+			return next_state(character, false, false);
+		}
+
+		ptr next_state_ignore_root_state(CharType character) const {
+			return next_state(character, true, true);
+		}
+
+		ptr add_state(CharType character) {
+			auto next = next_state_ignore_root_state(character);
+			if (next == nullptr) {
+				next = d_storage->states.create(d_depth + 1, character, d_storage, false);
+				d_success.insert(character, next);
+        if (next != this)
+          d_has_success = true;
+			}
+			return next;
+		}
+
+		ptr add_state(CharType character, ptr state) {
+			auto next = next_state_ignore_root_state(character);
+			if (next == nullptr) {
+				d_success.insert(character, state);
+        if (state != this)
+          d_has_success = true;
+      }
+			return state;
+		}
+
+		size_t get_depth() const { return d_depth; }
+
+		// Dense id, unique among the states sharing a root: 0 for the root,
+		// then in creation order.
+		std::uint32_t get_id() const { return d_id; }
+
+		// Number of states created under this state's root.
+		size_t num_states() const { return d_storage->num_states + 1; }
+
+		void add_emit(string_ref_type keyword, unsigned index) {
+			d_emits.insert(std::make_pair(keyword, index));
+		}
+
+		void add_emit(const string_collection& emits) {
+			for (const auto& e : emits) {
+				string_type str(e.first);
+				add_emit(str, e.second);
+			}
+		}
+
+		string_collection get_emits() const { return d_emits; }
+
+		const string_collection& emits() const { return d_emits; }
+
+		// Where this state's keyword ids sit in the owning trie's emit table;
+		// assigned when the trie is constructed, as emits() may grow before.
+		std::uint32_t first_emit() const { return d_first_emit; }
+		std::uint32_t num_emits() const { return d_num_emits; }
+
+		void set_emit_range(std::uint32_t first, std::uint32_t count) {
+			d_first_emit = first;
+			d_num_emits = count;
+		}
+
+    bool ending_pattern() const { return d_ending_pattern; }
+
+    void set_ending_pattern(bool ending_pattern) { d_ending_pattern = ending_pattern; }
+
+    CharType value() const { return d_value; }
+
+		ptr failure() const { return d_failure; }
+
+		void set_failure(ptr fail_state) { d_failure = fail_state; }
+
+		// Dictionary suffix link: the closest state along the failure chain
+		// that has emits, or nullptr. Only set by unanchored construction.
+		ptr output() const { return d_output; }
+
+		void set_output(ptr output_state) { d_output = output_state; }
+
+    bool has_success() const {return d_has_success;}
+
+		// Whether this '+' state stays the only successor of itself for every
+		// character but the separator; set when the trie is constructed.
+		bool skips_segment() const { return d_skips_segment; }
+		void set_skips_segment(bool skips) { d_skips_segment = skips; }
+
+		// Whether this state ends a keyword with a '#' that nothing follows,
+		// so it accepts whatever text is left; set with skips_segment.
+		bool accepts_remainder() const { return d_accepts_remainder; }
+		void set_accepts_remainder(bool accepts) { d_accepts_remainder = accepts; }
+
+		state_collection get_states() const {
+			state_collection result;
+			d_success.for_each([&result](CharType, ptr next) {
+				result.push_back(next);
+			});
+			return state_collection(result);
+		}
+
+		// Calls f(character, next) for every outgoing transition, without
+		// collecting them first.
+		template<typename Function>
+		void for_each_transition(Function f) const {
+			d_success.for_each(f);
+		}
+
+		transition_collection get_transitions() const {
+			transition_collection result;
+			d_success.for_each([&result](CharType character, ptr) {
+				result.push_back(character);
+			});
+			return transition_collection(result);
+		}
+
+	private:
+		friend class object_pool<state>;
+
+		state(size_t depth, type val, storage* s, bool owns_storage)
+			: d_owned_storage(owns_storage ? s : nullptr)
+			, d_storage(s)
+			, d_id(owns_storage ? 0 : ++s->num_states)
+			, d_depth(depth)
+			, d_root(depth == 0 ? this : nullptr)
+			, d_success(make_transitions<success_collection>(&s->transitions, depth))
+			, d_has_success(false)
+			, d_failure(nullptr)
+			, d_output(nullptr)
+			, d_emits()
+			, d_first_emit(0)
+			, d_num_emits(0)
+			, d_value(val)
+			, d_ending_pattern(false)
+			, d_skips_segment(false)
+			, d_accepts_remainder(false)
+			{}
+
+		ptr next_state(CharType character, bool ignore_root_state, bool state_insertion) const {
+			return d_success.find(character);
+		}
+	};
+
+	// Every state below a root lives in storage owned by that root, so a trie
+	// is built from a few large allocations and released in bulk.
+	template<typename CharType, template<typename, typename> class Transitions>
+	struct state<CharType, Transitions>::storage {
+		arena                                  transitions;
+		object_pool<state<CharType, Transitions>> states;
+		std::uint32_t                          num_states;
+
+		storage()
+			: transitions()
+			, states()
+			, num_states(0) {}
+	};
+
+	// class literal_index
+	//
+	// Minimal perfect hash over a fixed set of keywords, built by hash and
+	// displace: keys are spread over buckets of about four, and each bucket,
+	// largest first, is given the first seed that sends all of its keys to
+	// free slots. Single key buckets take a free slot directly. Every key
+	// owns exactly one slot, so a lookup is one hash, a fingerprint check and
+	// one comparison with the packed keyword text; any other text fails one
+	// of the two checks. There are no chains and no strings beyond d_text.
+	template<typename CharType>
+	class literal_index {
+	public:
+		typedef std::basic_string<CharType>                 string_type;
+		typedef std::pair<const unsigned*, const unsigned*> id_range;
+
+	private:
+		struct slot {
+			std::uint32_t fingerprint;
+			std::uint32_t first_char; // into d_text
+			std::uint32_t length;
+			unsigned      first_id;   // into d_ids, or the id itself when it is the only one
+			std::uint32_t num_ids;
+		};
+
+		enum : std::uint32_t {
+			direct_slot = 0x80000000u, // a seed with this bit set is the slot itself
+			max_seed    = 1u << 20,
+		};
+
+		std::vector<std::uint32_t> d_seeds; // by bucket
+		std::vector<slot>          d_slots;
+		std::vector<CharType>      d_text;
+		std::vector<unsigned>      d_ids;
+		std::uint64_t              d_salt;
+
+	public:
+		literal_index()
+			: d_seeds()
+			, d_slots()
+			, d_text()
+			, d_ids()
+			, d_salt(0) {}
+
+		// Indexes keywords[id] for every id in ids; equal keywords share a
+		// slot and report their ids in the order given.
+		void build(const std::vector<string_type>& keywords, std::vector<unsigned> ids) {
+			std::stable_sort(ids.begin(), ids.end(), [&](unsigned l, unsigned r) {
+				return keywords[l] < keywords[r];
+			});
+			d_slots.clear();
+			d_text.clear();
+			d_ids.clear();
+			std::vector<slot> entries;
+			for (size_t i = 0; i < ids.size(); ++i) {
+				const string_type& keyword = keywords[ids[i]];
+				if (i == 0 || keyword != keywords[ids[i - 1]]) {
+					slot e = { 0, static_cast<std::uint32_t>(d_text.size()), static_cast<std::uint32_t>(keyword.length()),
+						static_cast<std::uint32_t>(d_ids.size()), 0 };
+					entries.push_back(e);
+					d_text.insert(d_text.end(), keyword.begin(), keyword.end());
+				}
+				d_ids.push_back(ids[i]);
+				++entries.back().num_ids;
+			}
+			for (auto& e : entries) {
+				if (e.num_ids == 1) {
+					e.first_id = d_ids[e.first_id];
+				}
+			}
+			// a fresh salt separates keys whose hashes collide outright
+			for (d_salt = 0; !place(entries); ++d_salt) {
+			}
+		}
+
+		size_t size() const { return d_slots.size(); }
+
+		size_t memory_usage() const {
+			return d_seeds.size() * sizeof(std::uint32_t) + d_slots.size() * sizeof(slot)
+				+ d_text.size() * sizeof(CharType) + d_ids.size() * sizeof(unsigned);
+		}
+
+		// The ids of the keyword equal to the length characters at text, or
+		// an empty range. With fold_case the text is lower-cased first. text
+		// is a pointer or any forward iterator; it is read twice at most.
+		template<typename ForwardIterator>
+		id_range find(ForwardIterator text, size_t length, bool fold_case) const {
+			if (d_slots.empty())
+				return id_range(nullptr, nullptr);
+			std::uint64_t h = hash(text, length, fold_case, d_salt);
+			const slot& s = d_slots[slot_of(h, d_seeds[bucket_of(h)])];
+			if (s.fingerprint != fingerprint(h) || s.length != length || !equal(d_text.data() + s.first_char, text, length, fold_case))
+				return id_range(nullptr, nullptr);
+			if (s.num_ids == 1)
+				return id_range(&s.first_id, &s.first_id + 1);
+			return id_range(d_ids.data() + s.first_id, d_ids.data() + s.first_id + s.num_ids);
+		}
+
+	private:
+		static std::uint64_t mix(std::uint64_t h) {
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdULL;
+			h ^= h >> 33;
+			h *= 0xc4ceb9fe1a85ec53ULL;
+			h ^= h >> 33;
+			return h;
+		}
+
+		static CharType fold(CharType c, bool fold_case) {
+			return fold_case ? static_cast<CharType>(std::tolower(c)) : c;
+		}
+
+		// FNV-1a over the characters, finished by a 64-bit mixer.
+		template<typename ForwardIterator>
+		static std::uint64_t hash(ForwardIterator text, size_t length, bool fold_case, std::uint64_t salt) {
+			std::uint64_t h = 0xcbf29ce484222325ULL ^ mix(salt);
+			for (size_t i = 0; i < length; ++i, ++text) {
+				h ^= static_cast<typename std::make_unsigned<CharType>::type>(fold(*text, fold_case));
+				h *= 0x100000001b3ULL;
+			}
+			return mix(h);
+		}
+
+		static bool equal(const CharType* keyword, const CharType* text, size_t length, bool fold_case) {
+			if (!fold_case)
+				return std::memcmp(keyword, text, length * sizeof(CharType)) == 0;
+			return equal<const CharType*>(keyword, text, length, true);
+		}
+
+		template<typename ForwardIterator>
+		static bool equal(const CharType* keyword, ForwardIterator text, size_t length, bool fold_case) {
+			for (size_t i = 0; i < length; ++i, ++text) {
+				if (keyword[i] != fold(*text, fold_case))
+					return false;
+			}
+			return true;
+		}
+
+		static std::uint32_t fingerprint(std::uint64_t h) { return static_cast<std::uint32_t>(h); }
+
+		// Maps 32 hash bits onto [0, size) with a multiply instead of a division.
+		static size_t reduce(std::uint64_t bits, size_t size) {
+			return static_cast<size_t>(((bits & 0xffffffffULL) * size) >> 32);
+		}
+
+		size_t bucket_of(std::uint64_t h) const { return reduce(h >> 32, d_seeds.size()); }
+
+		size_t slot_of(std::uint64_t h, std::uint32_t seed) const {
+			if (seed & direct_slot)
+				return seed & ~direct_slot;
+			return reduce(mix(h ^ (seed * 0x9e3779b97f4a7c15ULL)), d_slots.size());
+		}
+
+		// Assigns every entry a slot under d_salt; fails if some bucket finds
+		// no seed, which takes keys with equal hashes.
+		bool place(const std::vector<slot>& entries) {
+			const size_t n = entries.size();
+			d_seeds.assign((n + 3) / 4, 0);
+			d_slots.assign(n, slot());
+			std::vector<std::uint64_t> hashes(n);
+			std::vector<std::vector<std::uint32_t>> buckets(d_seeds.size());
+			for (size_t i = 0; i < n; ++i) {
+				hashes[i] = hash(d_text.data() + entries[i].first_char, entries[i].length, false, d_salt);
+				buckets[bucket_of(hashes[i])].push_back(static_cast<std::uint32_t>(i));
+			}
+			std::vector<std::uint32_t> order(buckets.size());
+			for (size_t b = 0; b < order.size(); ++b) {
+				order[b] = static_cast<std::uint32_t>(b);
+			}
+			std::stable_sort(order.begin(), order.end(), [&](std::uint32_t l, std::uint32_t r) {
+				return buckets[l].size() > buckets[r].size();
+			});
+
+			std::vector<bool> taken(n, false);
+			std::vector<size_t> slots;
+			size_t next_free = 0;
+			for (auto b : order) {
+				const auto& members = buckets[b];
+				if (members.empty())
+					break;
+				if (members.size() == 1) {
+					while (taken[next_free]) {
+						++next_free;
+					}
+					d_seeds[b] = direct_slot | static_cast<std::uint32_t>(next_free);
+				} else {
+					std::uint32_t seed = 0;
+					for (; seed < max_seed; ++seed) {
+						slots.clear();
+						for (auto m : members) {
+							size_t s = slot_of(hashes[m], seed);
+							if (taken[s] || std::find(slots.begin(), slots.end(), s) != slots.end())
+								break;
+							slots.push_back(s);
+						}
+						if (slots.size() == members.size())
+							break;
+					}
+					if (seed == max_seed)
+						return false;
+					d_seeds[b] = seed;
+				}
+				for (auto m : members) {
+					size_t s = slot_of(hashes[m], d_seeds[b]);
+					taken[s] = true;
+					d_slots[s] = entries[m];
+					d_slots[s].fingerprint = fingerprint(hashes[m]);
+				}
+			}
+			return true;
+		}
+	};
+
+	// class basic_frozen_trie
+	//
+	// Immutable, pointer-free form of a basic_trie. States are numbered in BFS
+	// order and addressed by 32-bit ids; the transitions of a state occupy a
+	// contiguous, label-sorted range of d_labels/d_targets and its emits a
+	// contiguous range of d_emits. The mutable state tree stays the build-time
+	// structure, this is what the hot matching path walks.
+	//
+	// Unbranched literal runs are path compressed: a state that is only ever
+	// passed through is dropped and its label moves into the run of the state
+	// below it, which the matcher compares in one go. Wildcard states, states
+	// with emits or failure links are always kept.
+	//
+	// Branching literal regions can optionally be walked two bytes a step:
+	// d_pair_labels/d_pair_targets hold, per state, the label-sorted 16-bit
+	// pairs leading straight to a grandchild, whose compressed run is then
+	// matched as usual. Only states with no wildcard continuation on either
+	// level get pairs.
+	//
+	// Keywords without wildcards are not in the automaton at all: they are
+	// looked up in d_literals, a perfect hash over them, with the whole text.
+	//
+	// Thread safety: the members taking a match_context (match, match_ids,
+	// matches_any, first_match and parse_text) are const and may run
+	// concurrently on one trie as long as each thread passes its own
+	// context. parse_text(text) without one is const too, but allocates its
+	// buffers on every call.
+	template<typename CharType>
+	class basic_lazy_dfa;
+
+	template<typename CharType>
+	class basic_frozen_trie {
+		template<typename> friend class basic_lazy_dfa;
+
+	public:
+		typedef CharType                    char_type;
+		typedef std::uint32_t               state_id;
+		typedef std::basic_string<CharType> string_type;
+		typedef emit<CharType>              emit_type;
+		typedef std::vector<state_id>       state_collection;
+		typedef std::map<emit_type, bool>   emit_collection;
+
+	private:
+		// states waiting for the end of a compressed run, keyed by the
+		// position they become active at
+		typedef std::vector<std::pair<size_t, state_id>> deferred_collection;
+
+	public:
+		static const state_id npos = std::numeric_limits<state_id>::max();
+
+	private:
+		struct node {
+			std::uint32_t first_transition;
+			std::uint32_t num_transitions;
+			std::uint32_t first_emit;
+			std::uint32_t num_emits;
+			state_id      failure;
+			state_id      plus;     // get_state(id, '+'), resolved at freeze time
+			state_id      hash;     // get_state(id, '#'), resolved at freeze time
+			std::uint32_t first_run;
+			std::uint32_t run_length; // characters following the entry label
+			CharType      value;
+			bool          has_success;
+			bool          ending_pattern;
+			bool          skips_segment; // a '+' state left only by the separator
+			bool          accepts_remainder; // a terminal '#', accepting whatever follows
+		};
+
+		std::vector<node>        d_nodes;
+		std::vector<CharType>    d_labels;
+		std::vector<state_id>    d_targets;
+		std::vector<CharType>    d_runs;
+		std::vector<unsigned>    d_emits;
+		std::vector<string_type> d_keywords;
+		bool                     d_case_insensitive;
+		std::vector<std::uint32_t> d_pair_offsets; // state id -> first pair, plus an end sentinel; empty when off
+		std::vector<std::uint16_t> d_pair_labels;
+		std::vector<state_id>      d_pair_targets;
+		literal_index<CharType>    d_literals;
+
+	public:
+		basic_frozen_trie()
+			: d_nodes()
+			, d_labels()
+			, d_targets()
+			, d_runs()
+			, d_emits()
+			, d_keywords()
+			, d_case_insensitive(false)
+			, d_pair_offsets()
+			, d_pair_labels()
+			, d_pair_targets()
+			, d_literals()
+		{
+			d_nodes.push_back(make_node(0));
+		}
+
+		// root holds the keywords with a wildcard, the literal ones of
+		// keywords are indexed here.
+		template<template<typename, typename> class Transitions>
+		basic_frozen_trie(const state<CharType, Transitions>& root, const std::vector<string_type>& keywords,
+			bool case_insensitive, bool two_byte_stride = false)
+			: d_nodes()
+			, d_labels()
+			, d_targets()
+			, d_runs()
+			, d_emits()
+			, d_keywords(keywords)
+			, d_case_insensitive(case_insensitive)
+			, d_pair_offsets()
+			, d_pair_labels()
+			, d_pair_targets()
+			, d_literals()
+		{
+			typedef state<CharType, Transitions> source_type;
+			typedef std::pair<CharType, const source_type*> transition;
+
+			std::unordered_map<const source_type*, state_id> ids;
+			std::vector<const source_type*> order;
+			std::vector<transition> transitions;
+			ids[&root] = 0;
+			order.push_back(&root);
+			d_nodes.push_back(make_node(root.value()));
+
+			// order doubles as the BFS queue: children get consecutive ids when
+			// their parent is expanded, so every transition range is contiguous
+			for (size_t cur = 0; cur < order.size(); ++cur) {
+				const source_type* s = order[cur];
+				auto labels = s->get_transitions();
+				auto children = s->get_states();
+				transitions.clear();
+				for (size_t i = 0; i < labels.size(); ++i) {
+					transitions.push_back(transition(labels[i], children[i]));
+				}
+				std::sort(transitions.begin(), transitions.end(), [](const transition& a, const transition& b) {
+					return a.first < b.first;
+				});
+
+				node& n = d_nodes[cur];
+				n.first_transition = static_cast<std::uint32_t>(d_labels.size());
+				n.num_transitions = static_cast<std::uint32_t>(transitions.size());
+				n.has_success = s->has_success();
+				n.ending_pattern = s->ending_pattern();
+				for (const auto& t : transitions) {
+					state_id target = static_cast<state_id>(cur);
+					if (t.second != s) {
+						target = static_cast<state_id>(order.size());
+						ids[t.second] = target;
+						order.push_back(t.second);
+						d_nodes.push_back(make_node(t.second->value()));
+					}
+					d_labels.push_back(t.first);
+					d_targets.push_back(target);
+				}
+				auto emits = s->get_emits();
+				d_nodes[cur].first_emit = static_cast<std::uint32_t>(d_emits.size());
+				d_nodes[cur].num_emits = static_cast<std::uint32_t>(emits.size());
+				for (const auto& e : emits) {
+					d_emits.push_back(e.second);
+				}
+			}
+
+			// failure links only ever point back at states seen earlier
+			for (size_t i = 0; i < order.size(); ++i) {
+				auto fail = order[i]->failure();
+				d_nodes[i].failure = (fail == nullptr) ? npos : ids[fail];
+			}
+			for (size_t i = 0; i < d_nodes.size(); ++i) {
+				d_nodes[i].plus = get_state(static_cast<state_id>(i), '+');
+				d_nodes[i].hash = get_state(static_cast<state_id>(i), '#');
+			}
+			compress_paths();
+			for (size_t i = 0; i < d_nodes.size(); ++i) {
+				d_nodes[i].skips_segment = skips_segment(static_cast<state_id>(i));
+				d_nodes[i].accepts_remainder = accepts_any_suffix(static_cast<state_id>(i))
+					&& !d_nodes[i].has_success && d_nodes[i].plus == npos && d_nodes[i].failure == npos;
+			}
+			if (two_byte_stride) {
+				build_pairs(std::integral_constant<bool, sizeof(CharType) == 1>());
+			}
+			std::vector<unsigned> literals;
+			for (unsigned i = 0; i < d_keywords.size(); ++i) {
+				if (!has_wildcard(d_keywords[i]))
+					literals.push_back(i);
+			}
+			d_literals.build(d_keywords, literals);
+		}
+
+		size_t num_states() const { return d_nodes.size(); }
+		size_t num_transitions() const { return d_labels.size(); }
+		size_t num_pair_transitions() const { return d_pair_labels.size(); }
+		size_t num_literals() const { return d_literals.size(); }
+		size_t num_keywords() const { return d_keywords.size(); }
+
+		const string_type& get_keyword(unsigned index) const { return d_keywords[index]; }
+
+		bool is_case_insensitive() const { return d_case_insensitive; }
+
+		// Ids of the keyword without wildcards equal to the whole text, from
+		// the literal index; the automaton never reports these.
+		typename literal_index<CharType>::id_range find_literal(const CharType* text, size_t length) const {
+			return d_literals.find(text, length, d_case_insensitive);
+		}
+
+		// The character as the automaton sees it, lower-cased if case insensitive.
+		CharType normalise(CharType c) const {
+			return d_case_insensitive ? static_cast<CharType>(std::tolower(c)) : c;
+		}
+
+		state_id next_state(state_id id, CharType c) const {
+			const node& n = d_nodes[id];
+			auto first = d_labels.begin() + n.first_transition;
+			auto last = first + n.num_transitions;
+			auto found = std::lower_bound(first, last, c);
+			if (found == last || *found != c) {
+				return npos;
+			}
+			return d_targets[found - d_labels.begin()];
+		}
+
+		// Reusable buffers and result storage for match. The active state set
+		// is a sparse set over the state ids, so every state is held at most
+		// once however many '#' paths reach it, and clearing it between
+		// positions and calls costs nothing. Keep one per thread: once it has
+		// grown to fit the trie and the largest result, match no longer
+		// allocates.
+		class match_context {
+			friend class basic_frozen_trie;
+
+			state_collection          d_prev_states;
+			state_collection          d_cur_states;
+			deferred_collection       d_deferred;
+			sparse_set                d_seen;
+			sparse_set                d_accepted;
+			std::vector<match_result> d_matches;
+			std::vector<unsigned>     d_ids;
+			size_t                    d_peak_active;
+
+		public:
+			match_context()
+				: d_prev_states()
+				, d_cur_states()
+				, d_deferred()
+				, d_seen()
+				, d_accepted()
+				, d_matches()
+				, d_ids()
+				, d_peak_active(0) {}
+
+			// Results of the last match, ordered by start position then index.
+			const std::vector<match_result>& matches() const { return d_matches; }
+
+			// Keyword ids of the last match_ids, in ascending order.
+			const std::vector<unsigned>& ids() const { return d_ids; }
+
+			// Largest number of states active at one position so far.
+			size_t peak_active() const { return d_peak_active; }
+		};
+
+		emit_collection parse_text(const string_type& text) const {
+			return parse_text(text.data(), text.length());
+		}
+
+		emit_collection parse_text(const CharType* text, size_t length) const {
+			emit_collection collected_emits;
+			parse_text(text, length, [&](unsigned index, size_t start, size_t end) {
+				collected_emits[emit_type(start, end, d_keywords[index], index)] = true;
+			});
+			return emit_collection(collected_emits);
+		}
+
+		// Calls handler(index, start, end) once for every keyword matching the
+		// length characters at text, as the matches are found. The handler
+		// may return a value converting to true to stop the scan; returns
+		// whether it did.
+		template<typename Handler>
+		bool parse_text(const CharType* text, size_t length, Handler handler) const {
+			state_collection prev_states;
+			state_collection cur_states;
+			deferred_collection deferred;
+			prev_states.reserve(32);
+			cur_states.reserve(32);
+			scan_membership seen(cur_states);
+			state_list accepted;
+			size_t peak_active = 0;
+			return scan_keywords(text, length, prev_states, cur_states, deferred, seen, accepted, peak_active, handler);
+		}
+
+		// (text, length) calls resolve to the pointer overload, not to this one
+		template<typename Handler, typename = typename std::enable_if<!std::is_integral<Handler>::value>::type>
+		bool parse_text(const string_type& text, Handler handler) const {
+			return parse_text(text.data(), text.length(), handler);
+		}
+
+		// As above, using the buffers in ctx; a warm ctx makes this allocation
+		// free whenever the handler is.
+		template<typename Handler>
+		bool parse_text(const CharType* text, size_t length, Handler handler, match_context& ctx) const {
+			ctx.d_seen.reserve(d_nodes.size());
+			ctx.d_accepted.reserve(d_nodes.size());
+			return scan_keywords(text, length, ctx.d_prev_states, ctx.d_cur_states, ctx.d_deferred, ctx.d_seen,
+				ctx.d_accepted, ctx.d_peak_active, handler);
+		}
+
+		template<typename Handler>
+		bool parse_text(const string_type& text, Handler handler, match_context& ctx) const {
+			return parse_text(text.data(), text.length(), handler, ctx);
+		}
+
+		emit_collection parse_text(const string_type& text, match_context& ctx) const {
+			emit_collection collected_emits;
+			for (const auto& m : match(text, ctx)) {
+				collected_emits[emit_type(m.start, m.end, d_keywords[m.index], m.index)] = true;
+			}
+			return emit_collection(collected_emits);
+		}
+
+		// Matches the length characters at text, leaving the results in ctx.
+		const std::vector<match_result>& match(const CharType* text, size_t length, match_context& ctx) const {
+			ctx.d_matches.clear();
+			parse_text(text, length, [&](unsigned index, size_t start, size_t end) {
+				match_result m = { index, start, end };
+				ctx.d_matches.push_back(m);
+			}, ctx);
+			std::sort(ctx.d_matches.begin(), ctx.d_matches.end(), [](const match_result& l, const match_result& r) {
+				return l.start < r.start || (l.start == r.start && l.index < r.index);
+			});
+			return ctx.d_matches;
+		}
+
+		const std::vector<match_result>& match(const string_type& text, match_context& ctx) const {
+			return match(text.data(), text.length(), ctx);
+		}
+
+		// Ids of the keywords matching the length characters at text, without
+		// spans; get_keyword maps an id back to its text.
+		const std::vector<unsigned>& match_ids(const CharType* text, size_t length, match_context& ctx) const {
+			ctx.d_ids.clear();
+			parse_text(text, length, [&](unsigned index, size_t, size_t) {
+				ctx.d_ids.push_back(index);
+			}, ctx);
+			std::sort(ctx.d_ids.begin(), ctx.d_ids.end());
+			return ctx.d_ids;
+		}
+
+		const std::vector<unsigned>& match_ids(const string_type& text, match_context& ctx) const {
+			return match_ids(text.data(), text.length(), ctx);
+		}
+
+		// Whether any keyword matches the length characters at text. Scanning
+		// stops at the first accepting state, or as soon as a state ending in
+		// '#' is active, since that accepts whatever follows; no emit is built.
+		bool matches_any(const CharType* text, size_t length, match_context& ctx) const {
+			match_result result;
+			return first_match(text, length, result, ctx);
+		}
+
+		bool matches_any(const string_type& text, match_context& ctx) const {
+			return matches_any(text.data(), text.length(), ctx);
+		}
+
+		bool matches_any(const string_type& text) const {
+			match_context ctx;
+			return matches_any(text, ctx);
+		}
+
+		// Stores the first match found in result and returns true, or returns
+		// false if nothing matches. Stops scanning like matches_any, so the
+		// keyword reported is whichever match became certain first.
+		bool first_match(const CharType* text, size_t length, match_result& result, match_context& ctx) const {
+			auto literals = find_literal(text, length);
+			if (literals.first != literals.second) {
+				result.index = *literals.first;
+				result.start = 0;
+				result.end = length - 1;
+				return true;
+			}
+			ctx.d_seen.reserve(d_nodes.size());
+			return scan(text, length, ctx.d_prev_states, ctx.d_cur_states, ctx.d_deferred, ctx.d_seen, ctx.d_peak_active, true,
+				[&](size_t pos, state_id id) {
+					const node& n = d_nodes[id];
+					if (n.num_emits == 0)
+						return false;
+					result.index = d_emits[n.first_emit];
+					result.start = pos - d_keywords[result.index].size() + 1;
+					result.end = pos;
+					return true;
+				});
+		}
+
+		bool first_match(const string_type& text, match_result& result, match_context& ctx) const {
+			return first_match(text.data(), text.length(), result, ctx);
+		}
+
+		bool first_match(const string_type& text, match_result& result) const {
+			match_context ctx;
+			return first_match(text, result, ctx);
+		}
+
+#if __cplusplus >= 201703L
+		typedef std::basic_string_view<CharType> string_view_type;
+
+		// The C string overloads keep calls with a literal unambiguous between
+		// the string and string_view overloads.
+		emit_collection parse_text(string_view_type text) const { return parse_text(text.data(), text.length()); }
+		emit_collection parse_text(const CharType* text) const { return parse_text(string_view_type(text)); }
+
+		const std::vector<match_result>& match(string_view_type text, match_context& ctx) const {
+			return match(text.data(), text.length(), ctx);
+		}
+		const std::vector<match_result>& match(const CharType* text, match_context& ctx) const {
+			return match(string_view_type(text), ctx);
+		}
+
+		const std::vector<unsigned>& match_ids(string_view_type text, match_context& ctx) const {
+			return match_ids(text.data(), text.length(), ctx);
+		}
+		const std::vector<unsigned>& match_ids(const CharType* text, match_context& ctx) const {
+			return match_ids(string_view_type(text), ctx);
+		}
+#endif
+
+	private:
+		// Membership test for calls without a match_context: a scan of the
+		// states gathered so far, which is cheap for the few states usually
+		// active.
+		class scan_membership {
+			const state_collection& d_states;
+
+		public:
+			explicit scan_membership(const state_collection& states)
+				: d_states(states) {}
+
+			bool insert(state_id id) { return std::find(d_states.begin(), d_states.end(), id) == d_states.end(); }
+			void clear() {}
+		};
+
+		// Set of the few states accepting at the end of a text, for calls
+		// without a match_context.
+		class state_list {
+			state_collection d_states;
+
+		public:
+			bool insert(state_id id) {
+				if (std::find(d_states.begin(), d_states.end(), id) != d_states.end())
+					return false;
+				d_states.push_back(id);
+				return true;
+			}
+			void clear() { d_states.clear(); }
+		};
+
+		// Runs scan, calling handler for the keywords of every accepting state
+		// once; accepted remembers the states already reported.
+		template<typename Membership, typename AcceptedSet, typename Handler>
+		bool scan_keywords(const CharType* text, size_t length, state_collection& prev_states, state_collection& cur_states,
+			deferred_collection& deferred, Membership& seen, AcceptedSet& accepted, size_t& peak_active, Handler& handler) const {
+			auto literals = find_literal(text, length);
+			for (const unsigned* id = literals.first; id != literals.second; ++id) {
+				if (call_match_handler(handler, *id, 0, length - 1))
+					return true;
+			}
+			accepted.clear();
+			return scan(text, length, prev_states, cur_states, deferred, seen, peak_active, false,
+				[&](size_t pos, state_id id) {
+					if (!accepted.insert(id))
+						return false;
+					const node& n = d_nodes[id];
+					for (std::uint32_t i = n.first_emit; i < n.first_emit + n.num_emits; ++i) {
+						unsigned index = d_emits[i];
+						if (call_match_handler(handler, index, pos - d_keywords[index].size() + 1, pos))
+							return true;
+					}
+					return false;
+				});
+		}
+
+		// The matching loop shared by every entry point. accept(pos, id) is
+		// called whenever state id accepts at the last position; it may be
+		// called more than once for the same state, and stops the scan by
+		// returning true. With stop_when_certain set, accept is also called
+		// as soon as a state that is bound to accept there becomes active.
+		// Returns whether accept stopped the scan.
+		template<typename Membership, typename Accept>
+		bool scan(const CharType* text, size_t length, state_collection& prev_states, state_collection& cur_states,
+			deferred_collection& deferred, Membership& seen, size_t& peak_active, bool stop_when_certain, Accept accept) const {
+			prev_states.clear();
+			cur_states.clear();
+			deferred.clear();
+			seen.clear();
+			prev_states.push_back(0);
+
+			const size_t last = length - 1;
+			size_t pos = 0;
+			while (pos < length) {
+				resume_deferred(pos, prev_states, deferred);
+				if (prev_states.empty()) {
+					// nothing is active until the next compressed run ends
+					if (deferred.empty())
+						break;
+					pos = next_resume(deferred);
+					continue;
+				}
+
+				// a lone state in a literal region can take two bytes at once;
+				// the skipped state has no wildcard continuation and cannot
+				// accept, as pos + 1 is at most the last position
+				if (prev_states.size() == 1 && deferred.empty() && pos + 1 < length && !d_pair_offsets.empty()) {
+					state_id next = next_pair_state(prev_states[0], text[pos], text[pos + 1]);
+					if (next != npos) {
+						const node& next_node = d_nodes[next];
+						prev_states.clear();
+						if (next_node.run_length == 0) {
+							if (pos + 1 == last && accepts_at_end(next) && accept(pos + 1, next))
+								return true;
+							prev_states.push_back(next);
+						} else if (match_run(next_node, text, length, pos + 2)) {
+							size_t arrival = pos + 1 + next_node.run_length;
+							if (arrival == last && accepts_at_end(next) && accept(arrival, next))
+								return true;
+							deferred.push_back(std::make_pair(arrival + 1, next));
+						}
+						pos += 2;
+						continue;
+					}
+				}
+
+				if (prev_states.size() == 1 && deferred.empty() && d_nodes[prev_states[0]].skips_segment) {
+					// nothing changes before the separator, so jump to it
+					pos = static_cast<size_t>(find_separator(text + pos, text + length) - text);
+					if (pos == length)
+						return accepts_at_end(prev_states[0]) && accept(last, prev_states[0]);
+				}
+
+				CharType c = text[pos];
+				if (d_case_insensitive) {
+					c = std::tolower(c);
+				}
+
+				for (auto cur : prev_states) {
+					const node& cur_node = d_nodes[cur];
+					if (stop_when_certain && accepts_any_suffix(cur) && accept(last, cur))
+						return true;
+
+					// a state accepting the remainder is settled as soon as it
+					// is reached, so it never joins the active set
+					auto next = get_state(cur, c);
+					if (next != npos) {
+						const node& next_node = d_nodes[next];
+						if (next_node.run_length == 0) {
+							if (next_node.accepts_remainder) {
+								if (accept(last, next))
+									return true;
+							} else {
+								if (pos == last && accepts_at_end(next) && accept(pos, next))
+									return true;
+								if (seen.insert(next))
+									cur_states.push_back(next);
+							}
+						} else if (match_run(next_node, text, length, pos + 1)) {
+							size_t arrival = pos + next_node.run_length;
+							if (next_node.accepts_remainder) {
+								if (accept(last, next))
+									return true;
+							} else {
+								if (arrival == last && accepts_at_end(next) && accept(arrival, next))
+									return true;
+								auto entry = std::make_pair(arrival + 1, next);
+								if (std::find(deferred.begin(), deferred.end(), entry) == deferred.end())
+									deferred.push_back(entry);
+							}
+						}
+					}
+
+					if (!(cur_node.value == '+' && c == '.')) {
+						next = cur_node.plus;
+						if (next != npos) {
+							if (pos == last && accepts_at_end(next) && accept(pos, next))
+								return true;
+							if (seen.insert(next))
+								cur_states.push_back(next);
+						}
+					}
+
+					next = cur_node.hash;
+					if (next != npos) {
+						if (d_nodes[next].accepts_remainder) {
+							if (accept(last, next))
+								return true;
+						} else {
+							if (pos == last && accepts_at_end(next) && accept(pos, next))
+								return true;
+							if (seen.insert(next))
+								cur_states.push_back(next);
+						}
+					}
+				}
+
+				peak_active = std::max(peak_active, cur_states.size());
+				prev_states.swap(cur_states);
+				cur_states.clear();
+				seen.clear();
+				pos++;
+			}
+			return false;
+		}
+
+		static node make_node(CharType value) {
+			node n;
+			n.first_transition = 0;
+			n.num_transitions = 0;
+			n.first_emit = 0;
+			n.num_emits = 0;
+			n.failure = npos;
+			n.plus = npos;
+			n.hash = npos;
+			n.first_run = 0;
+			n.run_length = 0;
+			n.value = value;
+			n.has_success = false;
+			n.ending_pattern = false;
+			n.skips_segment = false;
+			n.accepts_remainder = false;
+			return n;
+		}
+
+		// Drops every state that is only passed through and renumbers the rest
+		// in BFS order, moving the dropped labels into the run of the state
+		// they lead to.
+		void compress_paths() {
+			std::vector<bool> passed_through(d_nodes.size(), false);
+			for (size_t i = 1; i < d_nodes.size(); ++i) {
+				const node& n = d_nodes[i];
+				passed_through[i] = n.num_transitions == 1 && d_targets[n.first_transition] != i
+					&& n.num_emits == 0 && !n.ending_pattern
+					&& n.failure == npos && n.plus == npos && n.hash == npos;
+			}
+
+			std::vector<node> nodes;
+			std::vector<CharType> labels;
+			std::vector<state_id> targets;
+			std::vector<CharType> runs;
+			std::vector<state_id> ids(d_nodes.size(), npos);
+			std::vector<state_id> order;
+			ids[0] = 0;
+			order.push_back(0);
+			nodes.push_back(d_nodes[0]);
+
+			for (size_t cur = 0; cur < order.size(); ++cur) {
+				const node& old = d_nodes[order[cur]];
+				nodes[cur].first_transition = static_cast<std::uint32_t>(labels.size());
+				for (std::uint32_t t = old.first_transition; t < old.first_transition + old.num_transitions; ++t) {
+					state_id target = d_targets[t];
+					if (target == order[cur]) {
+						labels.push_back(d_labels[t]);
+						targets.push_back(static_cast<state_id>(cur));
+						continue;
+					}
+					std::uint32_t first_run = static_cast<std::uint32_t>(runs.size());
+					while (passed_through[target]) {
+						const node& skipped = d_nodes[target];
+						runs.push_back(d_labels[skipped.first_transition]);
+						target = d_targets[skipped.first_transition];
+					}
+					ids[target] = static_cast<state_id>(nodes.size());
+					order.push_back(target);
+					nodes.push_back(d_nodes[target]);
+					nodes.back().first_run = first_run;
+					nodes.back().run_length = static_cast<std::uint32_t>(runs.size()) - first_run;
+					labels.push_back(d_labels[t]);
+					targets.push_back(ids[target]);
+				}
+			}
+
+			for (auto& n : nodes) {
+				n.failure = (n.failure == npos) ? npos : ids[n.failure];
+				n.plus = (n.plus == npos) ? npos : ids[n.plus];
+				n.hash = (n.hash == npos) ? npos : ids[n.hash];
+			}
+			d_nodes.swap(nodes);
+			d_labels.swap(labels);
+			d_targets.swap(targets);
+			d_runs.swap(runs);
+		}
+
+		bool skips_segment(state_id id) const {
+			const node& n = d_nodes[id];
+			if (n.value != '+' || n.plus != id || n.hash != npos || n.failure != npos)
+				return false;
+			for (std::uint32_t t = n.first_transition; t < n.first_transition + n.num_transitions; ++t) {
+				if (d_targets[t] != id && d_labels[t] != '.')
+					return false;
+			}
+			return true;
+		}
+
+		// A state can stride when neither it nor the child in between has a
+		// '+' or '#' continuation; a compressed run on the child is left to
+		// single steps.
+		bool can_stride(state_id id) const {
+			const node& n = d_nodes[id];
+			return n.plus == npos && n.hash == npos && n.run_length == 0;
+		}
+
+		void build_pairs(std::false_type /* wide characters */) {}
+
+		void build_pairs(std::true_type) {
+			std::vector<std::pair<std::uint16_t, state_id>> pairs;
+			d_pair_offsets.reserve(d_nodes.size() + 1);
+			for (size_t i = 0; i < d_nodes.size(); ++i) {
+				d_pair_offsets.push_back(static_cast<std::uint32_t>(d_pair_labels.size()));
+				const node& n = d_nodes[i];
+				if (n.plus != npos || n.hash != npos) {
+					continue;
+				}
+				pairs.clear();
+				for (std::uint32_t t = n.first_transition; t < n.first_transition + n.num_transitions; ++t) {
+					state_id child = d_targets[t];
+					if (child == i || !can_stride(child)) {
+						continue;
+					}
+					const node& m = d_nodes[child];
+					for (std::uint32_t u = m.first_transition; u < m.first_transition + m.num_transitions; ++u) {
+						state_id grandchild = d_targets[u];
+						if (grandchild != child) {
+							pairs.push_back(std::make_pair(pair_label(d_labels[t], d_labels[u]), grandchild));
+						}
+					}
+				}
+				std::sort(pairs.begin(), pairs.end());
+				for (const auto& p : pairs) {
+					d_pair_labels.push_back(p.first);
+					d_pair_targets.push_back(p.second);
+				}
+			}
+			d_pair_offsets.push_back(static_cast<std::uint32_t>(d_pair_labels.size()));
+		}
+
+		static std::uint16_t pair_label(CharType first, CharType second) {
+			return static_cast<std::uint16_t>((static_cast<unsigned char>(first) << 8) | static_cast<unsigned char>(second));
+		}
+
+		state_id next_pair_state(state_id id, CharType first, CharType second) const {
+			auto begin = d_pair_labels.begin() + d_pair_offsets[id];
+			auto end = d_pair_labels.begin() + d_pair_offsets[id + 1];
+			if (begin == end) {
+				return npos;
+			}
+			std::uint16_t label = pair_label(normalise(first), normalise(second));
+			auto found = std::lower_bound(begin, end, label);
+			if (found == end || *found != label) {
+				return npos;
+			}
+			return d_pair_targets[found - d_pair_labels.begin()];
+		}
+
+		bool match_run(const node& n, const CharType* text, size_t length, size_t pos) const {
+			if (length - pos < n.run_length) {
+				return false;
+			}
+			const CharType* run = d_runs.data() + n.first_run;
+			if (!d_case_insensitive) {
+				return std::char_traits<CharType>::compare(text + pos, run, n.run_length) == 0;
+			}
+			for (std::uint32_t i = 0; i < n.run_length; ++i) {
+				if (static_cast<CharType>(std::tolower(text[pos + i])) != run[i]) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void resume_deferred(size_t pos, state_collection& states, deferred_collection& deferred) const {
+			for (size_t i = 0; i < deferred.size(); ) {
+				if (deferred[i].first == pos) {
+					states.push_back(deferred[i].second);
+					deferred[i] = deferred.back();
+					deferred.pop_back();
+				} else {
+					++i;
+				}
+			}
+		}
+
+		static size_t next_resume(const deferred_collection& deferred) {
+			size_t result = std::numeric_limits<size_t>::max();
+			for (const auto& d : deferred) {
+				result = std::min(result, d.first);
+			}
+			return result;
+		}
+
+		bool accepts_at_end(state_id id) const {
+			return !d_nodes[id].has_success || d_nodes[id].ending_pattern;
+		}
+
+		// A state ending a keyword with '#' keeps itself active through its
+		// '#' self-loop and accepts whatever text follows it.
+		bool accepts_any_suffix(state_id id) const {
+			const node& n = d_nodes[id];
+			return n.hash == id && n.num_emits != 0 && accepts_at_end(id);
+		}
+
+		state_id get_state(state_id cur, CharType c) const {
+			state_id result = next_state(cur, c);
+			while (result == npos) {
+				cur = d_nodes[cur].failure;
+				if (cur == npos)
+					break;
+				result = next_state(cur, c);
+			}
+			return result;
+		}
+
+	};
+
+	template<typename CharType>
+	const typename basic_frozen_trie<CharType>::state_id basic_frozen_trie<CharType>::npos;
+
+	template<typename CharType, template<typename, typename> class Transitions = map_transitions>
+	class basic_trie {
+	public:
+		using string_type = std::basic_string < CharType > ;
+		using string_ref_type = std::basic_string<CharType>&;
+
+		typedef CharType                      char_type;
+		typedef state<CharType, Transitions>  state_type;
+		typedef state_type*                   state_ptr_type;
+		typedef token<CharType>         token_type;
+		typedef emit<CharType>          emit_type;
+		typedef std::vector<state_ptr_type> state_collection;
+		typedef std::vector<token_type> token_collection;
+		typedef std::map<emit_type, bool>  emit_collection;
+		typedef basic_frozen_trie<CharType> frozen_type;
+
+		// Unanchored mode must be chosen before the first insert: it changes
+		// how keywords are stored. Whole words and overlap removal only filter
+		// the emits returned by parse_text(text) and tokenise.
+		class config {
+			bool d_case_insensitive;
+			bool d_unanchored;
+			bool d_allow_overlaps;
+			bool d_only_whole_words;
+			bool d_full_dfa;
+			bool d_two_byte_stride;
+
+		public:
+			config()
+				: d_case_insensitive(false)
+				, d_unanchored(false)
+				, d_allow_overlaps(true)
+				, d_only_whole_words(false)
+				, d_full_dfa(false)
+				, d_two_byte_stride(false) {}
+
+			bool is_case_insensitive() const { return d_case_insensitive; }
+			void set_case_insensitive(bool val) { d_case_insensitive = val; }
+
+			bool is_unanchored() const { return d_unanchored; }
+			void set_unanchored(bool val) { d_unanchored = val; }
+
+			bool is_allow_overlaps() const { return d_allow_overlaps; }
+			void set_allow_overlaps(bool val) { d_allow_overlaps = val; }
+
+			bool is_only_whole_words() const { return d_only_whole_words; }
+			void set_only_whole_words(bool val) { d_only_whole_words = val; }
+
+			bool is_full_dfa() const { return d_full_dfa; }
+			void set_full_dfa(bool val) { d_full_dfa = val; }
+
+			bool is_two_byte_stride() const { return d_two_byte_stride; }
+			void set_two_byte_stride(bool val) { d_two_byte_stride = val; }
+		};
+
+		// Reusable buffers and result storage for match. d_active keeps each
+		// state in the active set once however many wildcard paths reach it.
+		// Keep one per thread: once it has grown to fit the trie and the
+		// largest result, match no longer allocates.
+		//
+		// The const members taking a context are safe to call from several
+		// threads at once, each with its own context, provided nothing
+		// inserts into the trie meanwhile. The members without one (tokenise,
+		// parse_text(text), matches_any(text)) share d_context and are not.
+		class match_context {
+			friend class basic_trie;
+
+			state_collection          d_prev_states;
+			state_collection          d_cur_states;
+			sparse_set                d_active;
+			sparse_set                d_accepted;
+			std::vector<match_result> d_matches;
+			std::vector<unsigned>     d_ids;
+
+		public:
+			match_context()
+				: d_prev_states()
+				, d_cur_states()
+				, d_active()
+				, d_accepted()
+				, d_matches()
+				, d_ids() {}
+
+			// Results of the last match, ordered by start position then index.
+			const std::vector<match_result>& matches() const { return d_matches; }
+
+			// Keyword ids of the last match_ids, in ascending order.
+			const std::vector<unsigned>& ids() const { return d_ids; }
+		};
+
+	private:
+		// In anchored mode every keyword goes to the cheapest engine able to
+		// match it: keywords without wildcards to d_literals, the same perfect
+		// hash the frozen trie uses, probed once with the whole text;
+		// "literal.#" keywords to d_prefixes, walked along the text;
+		// everything else to the wildcard automaton under d_root. The results
+		// of the three are simply combined.
+		enum keyword_kind {
+			literal_keyword,
+			prefix_keyword,
+			wildcard_keyword,
+		};
+
+		std::unique_ptr<state_type> d_root;
+		std::unique_ptr<state_type> d_prefixes; // "literal.#" keywords by their "literal.", emits at the '.'
+		std::vector<unsigned>       d_literal_ids; // ids of the keywords without wildcards
+		config                      d_config;
+		std::unique_ptr<std::once_flag> d_build_once; // the first scan after an insert builds the tables below
+		std::vector<string_type>    d_keywords; // pattern table, indexed by keyword id
+		mutable literal_index<CharType> d_literals; // over d_literal_ids
+		mutable std::vector<unsigned> d_emits;  // keyword ids, a contiguous range per state
+		mutable byte_classes        d_byte_classes; // full_dfa: columns of d_delta
+		mutable std::vector<std::uint32_t> d_delta;  // full_dfa: next state id by (state id, byte class)
+		mutable std::vector<state_ptr_type> d_id_states; // full_dfa: state by id
+		match_context               d_context; // parse_text buffers, reused across calls
+
+	public:
+		basic_trie(): basic_trie(config()) {}
+
+		basic_trie(const config& c)
+			: d_root(new state_type())
+			, d_prefixes(new state_type())
+			, d_literal_ids()
+			, d_config(c)
+			, d_build_once(new std::once_flag()) {}
+
+		basic_trie& case_insensitive() {
+			d_config.set_case_insensitive(true);
+			return (*this);
+		}
+
+		// Switches to classic Aho-Corasick substring search: keywords are
+		// matched anywhere in the text and '+', '#' and '.' are plain
+		// characters. Call before inserting; topic matching is the default,
+		// anchored mode.
+		basic_trie& unanchored() {
+			d_config.set_unanchored(true);
+			return (*this);
+		}
+
+		basic_trie& remove_overlaps() {
+			d_config.set_allow_overlaps(false);
+			return (*this);
+		}
+
+		basic_trie& only_whole_words() {
+			d_config.set_only_whole_words(true);
+			return (*this);
+		}
+
+		// Frozen copies of a byte trie walk branching literal regions two
+		// bytes per step; see basic_frozen_trie.
+		basic_trie& two_byte_stride() {
+			d_config.set_two_byte_stride(true);
+			return (*this);
+		}
+
+		// Unanchored mode only: resolves every (state, byte) pair ahead of
+		// time, so matching does one table lookup per byte instead of walking
+		// failure links. A state costs one 4-byte entry per byte class, that
+		// is per distinct pattern byte plus one; see transition_table_size.
+		basic_trie& full_dfa() {
+			static_assert(sizeof(CharType) == 1, "full_dfa requires a byte-sized character type");
+			d_config.set_full_dfa(true);
+			d_build_once.reset(new std::once_flag());
+			return (*this);
+		}
+
+		// Adds a keyword. Matching is safe from several threads at once, but
+		// inserting is not: it resets the tables the next scan rebuilds, so
+		// no other thread may be matching against the trie meanwhile. The
+		// same holds for clear() and the configuration setters.
+		void insert(const string_type& keyword) {
+			insert(keyword.data(), keyword.length());
+		}
+
+		void insert(const CharType* keyword, size_t length) {
+			if (length == 0)
+				return;
+			string_type str(keyword, length);
+			unsigned index = static_cast<unsigned>(d_keywords.size());
+			switch (d_config.is_unanchored() ? wildcard_keyword : classify(keyword, length)) {
+				case literal_keyword:
+					d_literal_ids.push_back(index);
+					d_build_once.reset(new std::once_flag());
+					break;
+				case prefix_keyword: {
+					state_ptr_type cur_state = d_prefixes.get();
+					for (size_t i = 0; i + 1 < length; ++i) {
+						cur_state = cur_state->add_state(keyword[i]);
+					}
+					cur_state->add_emit(str, index);
+					break;
+				}
+				case wildcard_keyword:
+					insert_state(*d_root, keyword, length, index);
+					d_build_once.reset(new std::once_flag());
+					break;
+			}
+			d_keywords.push_back(str);
+		}
+
+		// Drops every keyword, releasing all states at once.
+		void clear() {
+			d_root.reset(new state_type());
+			d_prefixes.reset(new state_type());
+			d_literal_ids.clear();
+			d_keywords.clear();
+			d_build_once.reset(new std::once_flag());
+		}
+
+		// Inserts every keyword in [first, last).
+		template<class InputIterator>
+		void insert(InputIterator first, InputIterator last) {
+			for (InputIterator it = first; it != last; ++it) {
+				insert(*it);
+			}
+		}
+
+		// Compiles the current keywords into an immutable basic_frozen_trie.
+		// Later inserts do not affect an already frozen copy. The frozen trie
+		// only implements anchored topic matching: keywords without wildcards
+		// go to its literal index, all others to one automaton. Throws
+		// std::logic_error on an unanchored trie, whose matches it could not
+		// reproduce.
+		frozen_type freeze() const {
+			if (d_config.is_unanchored()) {
+				throw std::logic_error("basic_trie::freeze: unanchored tries cannot be frozen");
+			}
+			state_type root;
+			for (unsigned i = 0; i < num_keywords(); ++i) {
+				if (has_wildcard(d_keywords[i])) {
+					insert_state(root, d_keywords[i].data(), d_keywords[i].length(), i);
+				}
+			}
+			return frozen_type(root, d_keywords, d_config.is_case_insensitive(), d_config.is_two_byte_stride());
+		}
+
+		// Builds the literal index, the emit table and, when unanchored, the
+		// failure links now instead of on the first scan. Scans call it
+		// themselves, so this only moves the cost, e.g. out of a timed loop.
+		void build() const {
+			check_construct_failure_states();
+		}
+
+		unsigned num_keywords() const { return static_cast<unsigned>(d_keywords.size()); }
+
+		// States of the automaton walked character by character; in anchored
+		// mode that only holds the keywords with a '+' or inner '#'.
+		size_t num_states() const { return d_root->num_states(); }
+
+		// Bytes held by the full_dfa transition table, 0 until the first
+		// match builds it.
+		size_t transition_table_size() const { return d_delta.size() * sizeof(std::uint32_t); }
+
+		// Keyword text for an id reported by match or match_ids.
+		const string_type& get_keyword(unsigned index) const { return d_keywords[index]; }
+
+		token_collection tokenise(const string_type& text) {
+			return tokenise(text.data(), text.length());
+		}
+
+		token_collection tokenise(const CharType* text, size_t length) {
+			token_collection tokens;
+			auto collected_emits = parse_text(text, length);
+			size_t last_pos = -1;
+			for (const auto& e : collected_emits) {
+				// emits are ordered by start; skip any overlapping the last match
+				if (last_pos != size_t(-1) && e.first.get_start() <= last_pos) {
+					continue;
+				}
+				if (e.first.get_start() - last_pos > 1) {
+					tokens.push_back(create_fragment(e.first, text, length, last_pos));
+				}
+				tokens.push_back(create_match(e.first, text));
+				last_pos = e.first.get_end();
+			}
+			if (length - last_pos > 1) {
+				tokens.push_back(create_fragment(typename token_type::emit_type(), text, length, last_pos));
+			}
+			return token_collection(tokens);
+		}
+
+		emit_collection parse_text(const string_type& text) {
+			return parse_text(text.data(), text.length());
+		}
+
+		emit_collection parse_text(const CharType* text, size_t length) {
+			return parse_text(text, text + length);
+		}
+
+		// Matches the characters in [first, last), which need only be a
+		// forward range; nothing is copied into a string.
+		template<class ForwardIterator>
+		emit_collection parse_text(ForwardIterator first, ForwardIterator last) {
+			emit_collection collected_emits;
+			parse_text(first, last, [&](unsigned index, size_t start, size_t end) {
+				collected_emits[emit_type(start, end, d_keywords[index], index)] = true;
+			}, d_context);
+			if (d_config.is_only_whole_words()) {
+				remove_partial_matches(first, last, collected_emits);
+			}
+			if (!d_config.is_allow_overlaps()) {
+				remove_overlapping_emits(collected_emits);
+			}
+			return emit_collection(collected_emits);
+		}
+
+		// Calls handler(index, start, end) once for every keyword matching the
+		// characters in [first, last), as the matches are found. The handler
+		// may return a value converting to true to stop the scan; returns
+		// whether it did. A warm ctx makes this allocation free whenever the
+		// handler is.
+		template<class ForwardIterator, typename Handler>
+		bool parse_text(ForwardIterator first, ForwardIterator last, Handler handler, match_context& ctx) const {
+			auto report_keyword = [&](size_t pos, unsigned index) {
+				return call_match_handler(handler, index, pos - d_keywords[index].size() + 1, pos);
+			};
+			auto report = [&](size_t pos, state_ptr_type state) {
+				for (std::uint32_t i = state->first_emit(); i < state->first_emit() + state->num_emits(); ++i) {
+					if (report_keyword(pos, d_emits[i]))
+						return true;
+				}
+				return false;
+			};
+			if (use_transition_table()) {
+				return scan_transition_table(first, last, report);
+			}
+			if (d_config.is_unanchored()) {
+				return scan_unanchored(first, last, report);
+			}
+			if (scan_literals(first, last, report_keyword) || scan_prefixes(first, last, report_keyword))
+				return true;
+			ctx.d_accepted.reserve(d_root->num_states());
+			ctx.d_accepted.clear();
+			return scan(first, last, ctx, false, [&](size_t pos, state_ptr_type state) {
+				return ctx.d_accepted.insert(state->get_id()) && report(pos, state);
+			});
+		}
+
+		template<typename Handler>
+		bool parse_text(const CharType* text, size_t length, Handler handler, match_context& ctx) const {
+			return parse_text(text, text + length, handler, ctx);
+		}
+
+		template<typename Handler>
+		bool parse_text(const string_type& text, Handler handler, match_context& ctx) const {
+			return parse_text(text.data(), text.data() + text.length(), handler, ctx);
+		}
+
+		template<typename Handler>
+		bool parse_text(const CharType* text, size_t length, Handler handler) {
+			return parse_text(text, text + length, handler, d_context);
+		}
+
+		// (text, length) calls resolve to the pointer overload, not to this one
+		template<typename Handler, typename = typename std::enable_if<!std::is_integral<Handler>::value>::type>
+		bool parse_text(const string_type& text, Handler handler) {
+			return parse_text(text.data(), text.data() + text.length(), handler, d_context);
+		}
+
+		// Matches the length characters at text, leaving the results in ctx.
+		const std::vector<match_result>& match(const CharType* text, size_t length, match_context& ctx) const {
+			return match(text, text + length, ctx);
+		}
+
+		const std::vector<match_result>& match(const string_type& text, match_context& ctx) const {
+			return match(text.data(), text.length(), ctx);
+		}
+
+		template<class ForwardIterator>
+		const std::vector<match_result>& match(ForwardIterator first, ForwardIterator last, match_context& ctx) const {
+			ctx.d_matches.clear();
+			parse_text(first, last, [&](unsigned index, size_t start, size_t end) {
+				match_result m = { index, start, end };
+				ctx.d_matches.push_back(m);
+			}, ctx);
+			std::sort(ctx.d_matches.begin(), ctx.d_matches.end(), [](const match_result& l, const match_result& r) {
+				return l.start < r.start || (l.start == r.start && l.index < r.index);
+			});
+			return ctx.d_matches;
+		}
+
+		// Ids of the keywords matching the length characters at text, without
+		// spans; get_keyword maps an id back to its text.
+		const std::vector<unsigned>& match_ids(const CharType* text, size_t length, match_context& ctx) const {
+			return match_ids(text, text + length, ctx);
+		}
+
+		const std::vector<unsigned>& match_ids(const string_type& text, match_context& ctx) const {
+			return match_ids(text.data(), text.length(), ctx);
+		}
+
+		template<class ForwardIterator>
+		const std::vector<unsigned>& match_ids(ForwardIterator first, ForwardIterator last, match_context& ctx) const {
+			ctx.d_ids.clear();
+			parse_text(first, last, [&](unsigned index, size_t, size_t) {
+				ctx.d_ids.push_back(index);
+			}, ctx);
+			std::sort(ctx.d_ids.begin(), ctx.d_ids.end());
+			return ctx.d_ids;
+		}
+
+		// Whether any keyword matches the length characters at text. Scanning
+		// stops at the first accepting state, or as soon as a state ending in
+		// '#' is active, since that accepts whatever follows; no emit is built.
+		bool matches_any(const CharType* text, size_t length, match_context& ctx) const {
+			match_result result;
+			return first_match(text, length, result, ctx);
+		}
+
+		bool matches_any(const string_type& text, match_context& ctx) const {
+			return matches_any(text.data(), text.length(), ctx);
+		}
+
+		bool matches_any(const string_type& text) {
+			return matches_any(text, d_context);
+		}
+
+		// Stores the first match found in result and returns true, or returns
+		// false if nothing matches. Stops scanning like matches_any, so the
+		// keyword reported is whichever match became certain first.
+		bool first_match(const CharType* text, size_t length, match_result& result, match_context& ctx) const {
+			auto accept_keyword = [&](size_t pos, unsigned index) {
+				result.index = index;
+				result.start = pos - d_keywords[index].size() + 1;
+				result.end = pos;
+				return true;
+			};
+			auto accept = [&](size_t pos, state_ptr_type state) {
+				return state->num_emits() != 0 && accept_keyword(pos, d_emits[state->first_emit()]);
+			};
+			if (use_transition_table()) {
+				return scan_transition_table(text, text + length, accept);
+			}
+			if (d_config.is_unanchored()) {
+				return scan_unanchored(text, text + length, accept);
+			}
+			if (scan_literals(text, text + length, accept_keyword) || scan_prefixes(text, text + length, accept_keyword))
+				return true;
+			return scan(text, text + length, ctx, true, accept);
+		}
+
+		bool first_match(const string_type& text, match_result& result, match_context& ctx) const {
+			return first_match(text.data(), text.length(), result, ctx);
+		}
+
+		bool first_match(const string_type& text, match_result& result) {
+			return first_match(text, result, d_context);
+		}
+
+#if __cplusplus >= 201703L
+		typedef std::basic_string_view<CharType> string_view_type;
+
+		// The C string overloads keep calls with a literal unambiguous between
+		// the string and string_view overloads.
+		void insert(string_view_type keyword) { insert(keyword.data(), keyword.length()); }
+		void insert(const CharType* keyword) { insert(string_view_type(keyword)); }
+
+		token_collection tokenise(string_view_type text) { return tokenise(text.data(), text.length()); }
+		token_collection tokenise(const CharType* text) { return tokenise(string_view_type(text)); }
+
+		emit_collection parse_text(string_view_type text) { return parse_text(text.data(), text.length()); }
+		emit_collection parse_text(const CharType* text) { return parse_text(string_view_type(text)); }
+
+		const std::vector<match_result>& match(string_view_type text, match_context& ctx) const {
+			return match(text.data(), text.length(), ctx);
+		}
+		const std::vector<match_result>& match(const CharType* text, match_context& ctx) const {
+			return match(string_view_type(text), ctx);
+		}
+
+		const std::vector<unsigned>& match_ids(string_view_type text, match_context& ctx) const {
+			return match_ids(text.data(), text.length(), ctx);
+		}
+		const std::vector<unsigned>& match_ids(const CharType* text, match_context& ctx) const {
+			return match_ids(string_view_type(text), ctx);
+		}
+#endif
+
+	private:
+		// The matching loop shared by every entry point. accept(pos, state) is
+		// called whenever a state accepts at the last position; it may be
+		// called more than once for the same state, and stops the scan by
+		// returning true. With stop_when_certain set, accept is also called
+		// as soon as a state that is bound to accept there becomes active.
+		// Returns whether accept stopped the scan.
+		template<typename ForwardIterator, typename Accept>
+		bool scan(ForwardIterator first, ForwardIterator last, match_context& ctx, bool stop_when_certain, Accept accept) const {
+      check_construct_failure_states();
+      const size_t end_pos = static_cast<size_t>(std::distance(first, last)) - 1;
+      // Several wildcard paths can reach the same state at one position;
+      // d_active keeps each state in cur_states once, so the active set is
+      // bounded by the number of states instead of the number of paths.
+      state_collection& prev_states = ctx.d_prev_states;
+      state_collection& cur_states = ctx.d_cur_states;
+      sparse_set& active = ctx.d_active;
+      prev_states.clear();
+      cur_states.clear();
+      active.reserve(d_root->num_states());
+      active.clear();
+      prev_states.push_back(d_root.get());
+
+      for (size_t pos = 0; first != last; ++pos) {
+				if (prev_states.size() == 1 && prev_states[0]->skips_segment()) {
+					// nothing changes before the separator, so jump to it
+					ForwardIterator separator = find_separator(first, last);
+					if (separator == last) {
+						state_ptr_type cur_state = prev_states[0];
+						return accepts_at_end(cur_state) && accept(end_pos, cur_state);
+					}
+					pos += static_cast<size_t>(std::distance(first, separator));
+					first = separator;
+				}
+
+				CharType c = *first;
+				const bool at_end = (++first == last);
+				if (d_config.is_case_insensitive()) {
+					c = std::tolower(c);
+				}
+
+        for (auto& cur_state: prev_states)
+        {
+          if (stop_when_certain && accepts_any_suffix(cur_state) && accept(end_pos, cur_state))
+            return true;
+
+          // a state accepting the remainder is settled as soon as it is
+          // reached, so it never joins the active set
+          auto state = get_state(cur_state, c);
+          if (state)
+          {
+            if (state->accepts_remainder()) {
+              if (accept(end_pos, state))
+                return true;
+            } else {
+              if (accepts_at_end(state) && at_end && accept(pos, state))  // state finished
+                return true;
+              if (active.insert(state->get_id()))
+                cur_states.push_back(state);
+            }
+          }
+
+          if (!(cur_state->value() == '+' && c == '.')) {
+            state = get_state(cur_state, '+');
+            if (state) {
+              if (accepts_at_end(state) && at_end && accept(pos, state))  // state finished
+                return true;
+              if (active.insert(state->get_id()))
+                cur_states.push_back(state);
+            }
+          }
+
+          state = get_state(cur_state, '#');
+          if (state)
+          {
+            if (state->accepts_remainder()) {
+              if (accept(end_pos, state))
+                return true;
+            } else {
+              if (accepts_at_end(state) && at_end && accept(pos, state))  // state finished
+                return true;
+              if (active.insert(state->get_id()))
+                cur_states.push_back(state);
+            }
+          }
+        }
+
+        prev_states.swap(cur_states);
+        cur_states.clear();
+        active.clear();
+        if (prev_states.empty())  // nothing left that could match
+          break;
+			}
+			return false;
+		}
+
+		// A keyword is a literal without any wildcard, a prefix when its only
+		// wildcard is a '#' ending it after a separator, and a wildcard
+		// keyword otherwise.
+		static keyword_kind classify(const CharType* keyword, size_t length) {
+			for (size_t i = 0; i < length; ++i) {
+				if (keyword[i] == '+' || keyword[i] == '#') {
+					bool trailing_hash = keyword[i] == '#' && i + 1 == length && i > 0 && keyword[i - 1] == '.';
+					return trailing_hash ? prefix_keyword : wildcard_keyword;
+				}
+			}
+			return literal_keyword;
+		}
+
+		// Adds the states of a keyword below root, the way anchored or
+		// unanchored matching walks them.
+		void insert_state(state_type& root, const CharType* keyword, size_t length, unsigned index) const {
+			state_ptr_type cur_state = &root;
+      state_ptr_type last_multi_wildcard = nullptr;
+
+			for (size_t i = 0; i < length; ++i) {
+				CharType ch = keyword[i];
+				cur_state = cur_state->add_state(ch);
+				if (d_config.is_unanchored())
+					continue;
+
+        // Of course! I know that handling failures this way, could bring some bugs for matching topics later,
+        // I'll be return and fix this section later...
+        // topics with multiple # and +s will have some problems because of this!
+        switch (ch) {
+          case '.':
+            if (last_multi_wildcard)
+              cur_state->set_failure(last_multi_wildcard);
+            break;
+          case '+':
+            cur_state->add_state('+', cur_state);
+            break;
+          case '#':
+            cur_state->add_state('#', cur_state);
+            last_multi_wildcard = cur_state;
+            break;
+        }
+			}
+
+      if (cur_state != &root)
+        cur_state->set_ending_pattern(true);
+
+			string_type str(keyword, length);
+			cur_state->add_emit(str, index);
+		}
+
+		// The literal keywords equal to the whole text, all accepted at its
+		// last position.
+		template<typename ForwardIterator, typename Accept>
+		bool scan_literals(ForwardIterator first, ForwardIterator last, Accept accept) const {
+			if (d_literal_ids.empty())
+				return false;
+			check_construct_failure_states();
+			const size_t length = static_cast<size_t>(std::distance(first, last));
+			auto found = d_literals.find(first, length, d_config.is_case_insensitive());
+			for (const unsigned* index = found.first; index != found.second; ++index) {
+				if (accept(length - 1, *index))
+					return true;
+			}
+			return false;
+		}
+
+		// The "literal.#" keywords whose "literal." starts the text and leaves
+		// at least one character for the '#'.
+		template<typename ForwardIterator, typename Accept>
+		bool scan_prefixes(ForwardIterator first, ForwardIterator last, Accept accept) const {
+			if (first == last)
+				return false;
+			const size_t end_pos = static_cast<size_t>(std::distance(first, last)) - 1;
+			state_ptr_type cur_state = d_prefixes.get();
+			for (size_t pos = 0; pos < end_pos && cur_state->has_success(); ++pos, ++first) {
+				CharType c = *first;
+				if (d_config.is_case_insensitive()) {
+					c = std::tolower(c);
+				}
+				cur_state = cur_state->next_state(c);
+				if (cur_state == nullptr)
+					return false;
+				for (const auto& e : cur_state->emits()) {
+					if (accept(end_pos, e.second))
+						return true;
+				}
+			}
+			return false;
+		}
+
+		// Classic Aho-Corasick pass: exactly one state is active, the failure
+		// links take it to the longest keyword prefix ending at each position
+		// and the output links enumerate every keyword ending there. accept is
+		// called once per (position, state with emits).
+		template<typename ForwardIterator, typename Accept>
+		bool scan_unanchored(ForwardIterator first, ForwardIterator last, Accept accept) const {
+			check_construct_failure_states();
+			const state_ptr_type root = d_root.get();
+			state_ptr_type cur_state = root;
+			for (size_t pos = 0; first != last; ++first, ++pos) {
+				CharType c = *first;
+				if (d_config.is_case_insensitive()) {
+					c = std::tolower(c);
+				}
+				cur_state = get_state(cur_state, c);
+				if (cur_state == nullptr) {
+					cur_state = root;
+					continue;
+				}
+				state_ptr_type out = (cur_state->num_emits() == 0) ? cur_state->output() : cur_state;
+				for (; out != nullptr; out = out->output()) {
+					if (accept(pos, out))
+						return true;
+				}
+			}
+			return false;
+		}
+
+		// Inserts only touch the keyword table and the state trees; the
+		// literal index, the emit table, and the failure and output links of
+		// unanchored mode, are rebuilt here on the first scan after them.
+		// Concurrent scans wait for the one building them.
+		void check_construct_failure_states() const {
+			std::call_once(*d_build_once, [this] {
+				d_literals.build(d_keywords, d_literal_ids);
+				construct_emit_table();
+				d_delta.clear();
+				d_id_states.clear();
+				if (d_config.is_unanchored()) {
+					construct_failure_states();
+					if (use_transition_table()) {
+						construct_transition_table();
+					}
+				}
+			});
+		}
+
+		bool use_transition_table() const {
+			return sizeof(CharType) == 1 && d_config.is_unanchored() && d_config.is_full_dfa();
+		}
+
+		// Same walk as scan_unanchored, with every failure chain already
+		// followed. The top bit of a table entry marks a target that has
+		// emits or an output link, so positions without a match never touch
+		// the state itself.
+		template<typename ForwardIterator, typename Accept>
+		bool scan_transition_table(ForwardIterator first, ForwardIterator last, Accept accept) const {
+			check_construct_failure_states();
+			const std::uint32_t* delta = d_delta.data();
+			const size_t width = d_byte_classes.num_classes();
+			std::uint32_t cur_state = 0;
+			for (size_t pos = 0; first != last; ++first, ++pos) {
+				const std::uint32_t next = delta[cur_state * width + d_byte_classes.get(static_cast<unsigned char>(*first))];
+				cur_state = next & ~reports_flag;
+				if (next & reports_flag) {
+					state_ptr_type s = d_id_states[cur_state];
+					state_ptr_type out = (s->num_emits() == 0) ? s->output() : s;
+					for (; out != nullptr; out = out->output()) {
+						if (accept(pos, out))
+							return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		enum : std::uint32_t { reports_flag = 0x80000000u };
+
+		// Rows are filled in BFS order, so the row of a state's failure state
+		// is complete by the time the state copies it. Case folding goes into
+		// the byte classes: an upper case byte shares the class of its lower
+		// case form, and upper case labels, which never match, get no column.
+		void construct_transition_table() const {
+			const bool fold = d_config.is_case_insensitive();
+			d_byte_classes = byte_classes();
+			for (const auto& keyword : d_keywords) {
+				for (CharType c : keyword) {
+					unsigned char b = static_cast<unsigned char>(c);
+					d_byte_classes.add(static_cast<unsigned char>(fold ? std::tolower(b) : b));
+				}
+			}
+			if (fold) {
+				for (int c = 0; c < 256; ++c) {
+					d_byte_classes.alias(static_cast<unsigned char>(c), static_cast<unsigned char>(std::tolower(c)));
+				}
+			}
+
+			const state_ptr_type root = d_root.get();
+			const size_t n = root->num_states();
+			const size_t width = d_byte_classes.num_classes();
+			d_delta.assign(n * width, 0);
+			d_id_states.assign(n, nullptr);
+			auto target = [](state_ptr_type next) {
+				bool reports = next->num_emits() != 0 || next->output() != nullptr;
+				return next->get_id() | (reports ? std::uint32_t(reports_flag) : 0u);
+			};
+			std::queue<state_ptr_type> pending;
+			pending.push(root);
+			while (!pending.empty()) {
+				state_ptr_type cur_state = pending.front();
+				pending.pop();
+				d_id_states[cur_state->get_id()] = cur_state;
+				std::uint32_t* row = d_delta.data() + cur_state->get_id() * width;
+				if (cur_state != root) {
+					const std::uint32_t* fail_row = d_delta.data() + cur_state->failure()->get_id() * width;
+					std::copy(fail_row, fail_row + width, row);
+				}
+				cur_state->for_each_transition([&](CharType c, state_ptr_type next) {
+					unsigned char b = static_cast<unsigned char>(c);
+					if (!fold || std::tolower(b) == b) {
+						row[d_byte_classes.get(b)] = target(next);
+					}
+					pending.push(next);
+				});
+			}
+		}
+
+		// Copies the keyword ids of every state into d_emits, one contiguous
+		// range each, so reporting k matches reads k consecutive ids. The
+		// wildcard self-loops are the only cycles in the tree.
+		void construct_emit_table() const {
+			const state_ptr_type root = d_root.get();
+			std::vector<bool> visited(root->num_states(), false);
+			std::queue<state_ptr_type> pending;
+			d_emits.clear();
+			visited[root->get_id()] = true;
+			pending.push(root);
+			while (!pending.empty()) {
+				state_ptr_type cur_state = pending.front();
+				pending.pop();
+				cur_state->set_emit_range(static_cast<std::uint32_t>(d_emits.size()),
+					static_cast<std::uint32_t>(cur_state->emits().size()));
+				for (const auto& e : cur_state->emits()) {
+					d_emits.push_back(e.second);
+				}
+				cur_state->set_skips_segment(skips_segment(cur_state));
+				cur_state->set_accepts_remainder(accepts_remainder(cur_state));
+				cur_state->for_each_transition([&](CharType, state_ptr_type next) {
+					if (!visited[next->get_id()]) {
+						visited[next->get_id()] = true;
+						pending.push(next);
+					}
+				});
+			}
+		}
+
+		// A '+' state whose only ways on are its self loop and the separator
+		// keeps being the one successor of itself until the next '.'.
+		static bool skips_segment(state_ptr_type s) {
+			if (s->value() != '+' || s->failure() != nullptr || s->next_state('+') != s)
+				return false;
+			bool skips = true;
+			s->for_each_transition([&](CharType c, state_ptr_type next) {
+				skips = skips && (next == s || c == '.');
+			});
+			return skips;
+		}
+
+		// A '#' self loop with emits and no other way on stays active, and
+		// alone, until the end of any text.
+		static bool accepts_remainder(state_ptr_type s) {
+			return accepts_any_suffix(s) && !s->has_success() && s->failure() == nullptr;
+		}
+
+		// Breadth-first, so the failure state of every parent is final before
+		// its children are linked.
+		void construct_failure_states() const {
+			const state_ptr_type root = d_root.get();
+			std::queue<state_ptr_type> pending;
+			root->for_each_transition([&](CharType, state_ptr_type next) {
+				next->set_failure(root);
+				next->set_output(nullptr);
+				pending.push(next);
+			});
+			while (!pending.empty()) {
+				state_ptr_type cur_state = pending.front();
+				pending.pop();
+				cur_state->for_each_transition([&](CharType c, state_ptr_type next) {
+					state_ptr_type fail = cur_state->failure();
+					state_ptr_type target = fail->next_state(c);
+					while (target == nullptr && fail != root) {
+						fail = fail->failure();
+						target = fail->next_state(c);
+					}
+					next->set_failure(target == nullptr ? root : target);
+					fail = next->failure();
+					next->set_output(fail->num_emits() == 0 ? fail->output() : fail);
+					pending.push(next);
+				});
+			}
+		}
+
+		static bool is_word_char(CharType c) {
+			auto value = std::char_traits<CharType>::to_int_type(c);
+			return value >= 0 && value <= std::numeric_limits<unsigned char>::max() && std::isalnum(value);
+		}
+
+		template<typename ForwardIterator>
+		void remove_partial_matches(ForwardIterator first, ForwardIterator last, emit_collection& collected_emits) const {
+			std::vector<bool> word;
+			for (; first != last; ++first) {
+				word.push_back(is_word_char(*first));
+			}
+			for (auto it = collected_emits.begin(); it != collected_emits.end();) {
+				size_t start = it->first.get_start();
+				size_t end = it->first.get_end();
+				if ((start > 0 && word[start - 1]) || (end + 1 < word.size() && word[end + 1])) {
+					it = collected_emits.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+
+		// Keeps the longest of any overlapping emits, then the leftmost.
+		void remove_overlapping_emits(emit_collection& collected_emits) const {
+			std::vector<emit_type> emits;
+			for (const auto& e : collected_emits) {
+				emits.push_back(e.first);
+			}
+			interval_tree<emit_type> tree(emits);
+			collected_emits.clear();
+			for (const auto& e : tree.remove_overlaps(emits)) {
+				collected_emits[e] = true;
+			}
+		}
+
+		token_type create_fragment(const typename token_type::emit_type& e, const CharType* text, size_t length, size_t last_pos) const {
+			auto start = last_pos + 1;
+			auto end = (e.is_empty()) ? length : e.get_start();
+			auto len = end - start;
+			typename token_type::string_type str(text + start, len);
+			return token_type(str);
+		}
+
+		token_type create_match(const typename token_type::emit_type& e, const CharType* text) const {
+			auto start = e.get_start();
+			auto end = e.get_end() + 1;
+			auto len = end - start;
+			typename token_type::string_type str(text + start, len);
+			return token_type(str, e);
+		}
+
+		// A state ending a keyword with '#' keeps itself active through its
+		// '#' self-loop and accepts whatever text follows it.
+		static bool accepts_any_suffix(state_ptr_type s) {
+			return s->value() == '#' && s->next_state('#') == s && !s->emits().empty()
+				&& accepts_at_end(s);
+		}
+
+		// A state accepts when the text ends on it if no keyword continues
+		// past it or one ends there.
+		static bool accepts_at_end(state_ptr_type s) {
+			return !s->has_success() || s->ending_pattern();
+		}
+
+		state_ptr_type get_state(state_ptr_type cur_state, CharType c) const {
+			state_ptr_type result = cur_state->next_state(c);
+			while (result == nullptr) {
+				cur_state = cur_state->failure();
+        if (cur_state == nullptr)
+          break;
+				result = cur_state->next_state(c);
+			}
+			return result;
+		}
+
+	};
+
+	// class segment_table
+	//
+	// Interns strings to dense 32-bit ids. The characters of every interned
+	// string are packed into one buffer and looked up by pointer and length,
+	// so probing it never builds a temporary string.
+	template<typename CharType>
+	class segment_table {
+	public:
+		typedef std::uint32_t segment_id;
+
+		static const segment_id npos = std::numeric_limits<segment_id>::max();
+
+	private:
+		struct slot {
+			std::uint32_t hash;
+			segment_id    id;      // npos marks an empty slot
+		};
+
+		std::vector<slot>          d_slots;
+		std::vector<CharType>      d_chars;
+		std::vector<std::uint32_t> d_offsets;   // id -> start in d_chars, plus an end sentinel
+
+	public:
+		segment_table()
+			: d_slots(16, slot{0, npos})
+			, d_chars()
+			, d_offsets(1, 0) {}
+
+		size_t size() const { return d_offsets.size() - 1; }
+
+		segment_id find(const CharType* str, size_t len) const {
+			std::uint32_t h = hash(str, len);
+			size_t mask = d_slots.size() - 1;
+			for (size_t i = h & mask; d_slots[i].id != npos; i = (i + 1) & mask) {
+				if (d_slots[i].hash == h && equals(d_slots[i].id, str, len)) {
+					return d_slots[i].id;
+				}
+			}
+			return npos;
+		}
+
+		segment_id insert(const CharType* str, size_t len) {
+			auto found = find(str, len);
+			if (found != npos) {
+				return found;
+			}
+			if ((size() + 1) * 4 > d_slots.size() * 3) {
+				rehash(d_slots.size() * 2);
+			}
+			segment_id id = static_cast<segment_id>(size());
+			d_chars.insert(d_chars.end(), str, str + len);
+			d_offsets.push_back(static_cast<std::uint32_t>(d_chars.size()));
+			place(d_slots, slot{hash(str, len), id});
+			return id;
+		}
+
+		// FNV-1a over the character values
+		static std::uint32_t hash(const CharType* str, size_t len) {
+			std::uint32_t h = 2166136261u;
+			for (size_t i = 0; i < len; ++i) {
+				h = (h ^ static_cast<std::uint32_t>(str[i])) * 16777619u;
+			}
+			return h;
+		}
+
+	private:
+		bool equals(segment_id id, const CharType* str, size_t len) const {
+			size_t begin = d_offsets[id];
+			return d_offsets[id + 1] - begin == len
+				&& std::char_traits<CharType>::compare(d_chars.data() + begin, str, len) == 0;
+		}
+
+		static void place(std::vector<slot>& slots, slot s) {
+			size_t mask = slots.size() - 1;
+			size_t i = s.hash & mask;
+			while (slots[i].id != npos) {
+				i = (i + 1) & mask;
+			}
+			slots[i] = s;
+		}
+
+		void rehash(size_t capacity) {
+			std::vector<slot> slots(capacity, slot{0, npos});
+			for (const auto& s : d_slots) {
+				if (s.id != npos) {
+					place(slots, s);
+				}
+			}
+			d_slots.swap(slots);
+		}
+	};
+
+	template<typename CharType>
+	const typename segment_table<CharType>::segment_id segment_table<CharType>::npos;
+
+	// class edge_table
+	//
+	// Open-addressing map from a (state, segment) pair to the next state.
+	class edge_table {
+		struct slot {
+			std::uint64_t key;
+			std::uint32_t value;
+		};
+
+		static const std::uint64_t empty = ~std::uint64_t(0);
+
+		std::vector<slot> d_slots;
+		size_t            d_size;
+
+	public:
+		static const std::uint32_t npos = ~std::uint32_t(0);
+
+		edge_table()
+			: d_slots(16, slot{empty, npos})
+			, d_size(0) {}
+
+		size_t size() const { return d_size; }
+
+		std::uint32_t find(std::uint32_t from, std::uint32_t label) const {
+			std::uint64_t key = make_key(from, label);
+			size_t mask = d_slots.size() - 1;
+			for (size_t i = hash(key) & mask; d_slots[i].key != empty; i = (i + 1) & mask) {
+				if (d_slots[i].key == key) {
+					return d_slots[i].value;
+				}
+			}
+			return npos;
+		}
+
+		void insert(std::uint32_t from, std::uint32_t label, std::uint32_t to) {
+			if ((d_size + 1) * 4 > d_slots.size() * 3) {
+				std::vector<slot> slots(d_slots.size() * 2, slot{empty, npos});
+				for (const auto& s : d_slots) {
+					if (s.key != empty) {
+						place(slots, s);
+					}
+				}
+				d_slots.swap(slots);
+			}
+			if (place(d_slots, slot{make_key(from, label), to})) {
+				++d_size;
+			}
+		}
+
+	private:
+		static std::uint64_t make_key(std::uint32_t from, std::uint32_t label) {
+			return (static_cast<std::uint64_t>(from) << 32) | label;
+		}
+
+		static size_t hash(std::uint64_t key) {
+			key ^= key >> 33;
+			key *= 0xff51afd7ed558ccdULL;
+			key ^= key >> 33;
+			return static_cast<size_t>(key);
+		}
+
+		static bool place(std::vector<slot>& slots, slot s) {
+			size_t mask = slots.size() - 1;
+			size_t i = hash(s.key) & mask;
+			while (slots[i].key != empty) {
+				if (slots[i].key == s.key) {
+					slots[i].value = s.value;
+					return false;
+				}
+				i = (i + 1) & mask;
+			}
+			slots[i] = s;
+			return true;
+		}
+	};
+
+	// class basic_topic_trie
+	//
+	// Segment-level topic matcher. Patterns and topics are split on the
+	// separator and every literal segment is interned to an integer id, so a
+	// topic costs one intern probe plus one edge probe per segment and active
+	// state instead of a transition per character. '+' matches exactly one
+	// segment, '#' one or more; wildcards only count as whole segments.
+	// Segments may be empty: "a..b" has three, so "a.+.b" and "a.#.b" match
+	// it and "a.+" matches "a.". The character engines (basic_trie,
+	// basic_frozen_trie, basic_lazy_dfa) do not treat empty segments this
+	// way, so on such topics their matches differ.
+	template<typename CharType>
+	class basic_topic_trie {
+	public:
+		typedef std::basic_string<CharType> string_type;
+		typedef std::uint32_t               state_id;
+		typedef emit<CharType>              emit_type;
+		typedef std::vector<emit_type>      emit_collection;
+		typedef std::vector<state_id>       state_collection;
+		typedef segment_table<CharType>     segment_table_type;
+
+		static const state_id npos = std::numeric_limits<state_id>::max();
+
+	private:
+		struct node {
+			state_id              plus;    // child for a '+' segment
+			state_id              hash;    // child for a '#' segment
+			bool                  multi;   // node is a '#' and may absorb further segments
+			std::vector<unsigned> emits;
+		};
+
+		std::vector<node>        d_nodes;
+		segment_table_type       d_segments;
+		edge_table               d_edges;
+		std::vector<string_type> d_keywords;
+		CharType                 d_separator;
+
+	public:
+		explicit basic_topic_trie(CharType separator = '.')
+			: d_nodes(1, make_node(false))
+			, d_segments()
+			, d_edges()
+			, d_keywords()
+			, d_separator(separator) {}
+
+		size_t num_states() const { return d_nodes.size(); }
+		size_t num_segments() const { return d_segments.size(); }
+		size_t num_keywords() const { return d_keywords.size(); }
+
+		const string_type& get_keyword(unsigned index) const { return d_keywords[index]; }
+
+		void insert(const string_type& keyword) {
+			if (keyword.empty())
+				return;
+			state_id cur = 0;
+			size_t start = 0;
+			while (true) {
+				size_t end = keyword.find(d_separator, start);
+				if (end == string_type::npos) {
+					end = keyword.size();
+				}
+				cur = add_segment(cur, keyword.data() + start, end - start);
+				if (end == keyword.size())
+					break;
+				start = end + 1;
+			}
+			d_nodes[cur].emits.push_back(static_cast<unsigned>(d_keywords.size()));
+			d_keywords.push_back(keyword);
+		}
+
+		template<class InputIterator>
+		void insert(InputIterator first, InputIterator last) {
+			for (InputIterator it = first; it != last; ++it) {
+				insert(*it);
+			}
+		}
+
+		// Every pattern matching the whole topic, ordered by insertion index.
+		emit_collection parse_text(const string_type& text) const {
+			emit_collection collected_emits;
+			if (text.empty())
+				return collected_emits;
+
+			state_collection cur_states(1, 0);
+			state_collection next_states;
+			size_t start = 0;
+			while (true) {
+				size_t end = text.find(d_separator, start);
+				if (end == string_type::npos) {
+					end = text.size();
+				}
+				auto segment = d_segments.find(text.data() + start, end - start);
+
+				next_states.clear();
+				for (auto cur : cur_states) {
+					const node& n = d_nodes[cur];
+					if (segment != segment_table_type::npos) {
+						add_unique(next_states, d_edges.find(cur, segment));
+					}
+					add_unique(next_states, n.plus);
+					add_unique(next_states, n.hash);
+					if (n.multi) {
+						add_unique(next_states, cur);
+					}
+				}
+				cur_states.swap(next_states);
+				if (cur_states.empty() || end == text.size())
+					break;
+				start = end + 1;
+			}
+
+			std::vector<unsigned> matched;
+			for (auto cur : cur_states) {
+				matched.insert(matched.end(), d_nodes[cur].emits.begin(), d_nodes[cur].emits.end());
+			}
+			std::sort(matched.begin(), matched.end());
+			for (auto index : matched) {
+				collected_emits.push_back(emit_type(0, text.size() - 1, d_keywords[index], index));
+			}
+			return collected_emits;
+		}
+
+	private:
+		static node make_node(bool multi) {
+			node n;
+			n.plus = npos;
+			n.hash = npos;
+			n.multi = multi;
+			return n;
+		}
+
+		static void add_unique(state_collection& states, state_id id) {
+			if (id != npos && std::find(states.begin(), states.end(), id) == states.end()) {
+				states.push_back(id);
+			}
+		}
+
+		state_id add_segment(state_id cur, const CharType* segment, size_t len) {
+			if (len == 1 && (segment[0] == '+' || segment[0] == '#')) {
+				bool multi = segment[0] == '#';
+				state_id next = multi ? d_nodes[cur].hash : d_nodes[cur].plus;
+				if (next == npos) {
+					next = static_cast<state_id>(d_nodes.size());
+					d_nodes.push_back(make_node(multi));
+					(multi ? d_nodes[cur].hash : d_nodes[cur].plus) = next;
+				}
+				return next;
+			}
+			auto id = d_segments.insert(segment, len);
+			state_id next = d_edges.find(cur, id);
+			if (next == npos) {
+				next = static_cast<state_id>(d_nodes.size());
+				d_nodes.push_back(make_node(false));
+				d_edges.insert(cur, id, next);
+			}
+			return next;
+		}
+	};
+
+	template<typename CharType>
+	const typename basic_topic_trie<CharType>::state_id basic_topic_trie<CharType>::npos;
+
+	// class basic_lazy_dfa
+	//
+	// Determinizes a basic_frozen_trie on demand, in the spirit of RE2's DFA.
+	// A DFA state is the set of NFA items active at a position; its successor
+	// for a character is computed the first time that character is seen and
+	// then cached, so a warm cache costs one table lookup per character. When
+	// the cache outgrows its memory budget it is flushed and the text being
+	// matched is finished by plain NFA simulation.
+	//
+	// The frozen trie must outlive the DFA. Matching mutates the cache, so a
+	// basic_lazy_dfa must not be shared between threads.
+	template<typename CharType>
+	class basic_lazy_dfa {
+	public:
+		typedef basic_frozen_trie<CharType>            trie_type;
+		typedef typename trie_type::string_type        string_type;
+		typedef typename trie_type::emit_type          emit_type;
+		typedef typename trie_type::emit_collection    emit_collection;
+		typedef typename trie_type::state_id           state_id;
+		typedef std::uint32_t                          dfa_state_id;
+
+		enum : size_t {
+			default_memory_budget = 8 * 1024 * 1024,
+		};
+
+	private:
+		// An NFA item is a frozen state plus how far into its compressed run the
+		// text has got; the item sits on the state itself once offset equals the
+		// run length. Packed as state << 32 | offset.
+		typedef std::uint64_t          item;
+		typedef std::vector<item>      item_collection;
+
+		enum : dfa_state_id {
+			dead_state = 0,
+			unknown    = ~dfa_state_id(0),
+		};
+
+		enum : size_t {
+			table_size = 256, // codes below this go through d_classes, the rest through d_wide_transitions
+		};
+
+		struct dfa_state {
+			item_collection                  items;
+			std::vector<unsigned>            accepts;   // pattern ids if the text ends here
+			std::unique_ptr<dfa_state_id[]>  next;
+		};
+
+		struct item_hash {
+			size_t operator()(const item_collection& items) const {
+				std::uint64_t h = 14695981039346656037ULL;
+				for (auto i : items) {
+					h = (h ^ i) * 1099511628211ULL;
+				}
+				return static_cast<size_t>(h);
+			}
+		};
+
+		const trie_type*                                             d_trie;
+		byte_classes                                                 d_classes; // columns of dfa_state::next
+		size_t                                                       d_memory_budget;
+		size_t                                                       d_memory_usage;
+		size_t                                                       d_num_flushes;
+		std::vector<dfa_state>                                       d_states;
+		std::unordered_map<item_collection, dfa_state_id, item_hash> d_cache;
+		edge_table                                                   d_wide_transitions;
+		dfa_state_id                                                 d_start;
+		std::vector<dfa_state_id>                                    d_batch_states; // match_batch buffers
+		std::vector<size_t>                                          d_batch_active;
+
+	public:
+		explicit basic_lazy_dfa(const trie_type& trie, size_t memory_budget = default_memory_budget)
+			: d_trie(&trie)
+			, d_classes(make_classes(trie))
+			, d_memory_budget(memory_budget)
+			, d_memory_usage(0)
+			, d_num_flushes(0)
+			, d_states()
+			, d_cache()
+			, d_wide_transitions()
+			, d_start(unknown)
+			, d_batch_states()
+			, d_batch_active()
+		{
+			reset();
+		}
+
+		size_t num_states() const { return d_states.size(); }
+		size_t num_flushes() const { return d_num_flushes; }
+		size_t memory_usage() const { return d_memory_usage; }
+
+		emit_collection parse_text(const string_type& text) {
+			emit_collection collected_emits;
+			dfa_state_id cur = d_start;
+			size_t pos = 0;
+			for (; pos < text.length() && cur != dead_state; ++pos) {
+				CharType c = d_trie->normalise(text[pos]);
+				dfa_state_id next = cached_transition(cur, c);
+				if (next == unknown) {
+					next = add_transition(cur, c);
+					if (next == unknown) {
+						break;
+					}
+				}
+				cur = next;
+			}
+			if (pos < text.length() && cur != dead_state) {
+				// the cache was flushed: finish this text on the NFA
+				item_collection items = d_states[cur].items;
+				reset();
+				item_collection next_items;
+				for (; pos < text.length() && !items.empty(); ++pos) {
+					step(items, d_trie->normalise(text[pos]), next_items);
+					items.swap(next_items);
+				}
+				store_emits(text.length() - 1, accepts(items), collected_emits);
+				store_literals(text, collected_emits);
+				return emit_collection(collected_emits);
+			}
+			if (!text.empty()) {
+				store_emits(text.length() - 1, d_states[cur].accepts, collected_emits);
+			}
+			store_literals(text, collected_emits);
+			return emit_collection(collected_emits);
+		}
+
+		// Matches texts[0, count) in lockstep. Each round advances every
+		// unfinished text by one character and prefetches the table entry its
+		// next character will read, so the cache misses of the texts overlap
+		// instead of being taken one after another. Text is anything with
+		// data() and size(), such as std::string or std::string_view.
+		//
+		// results is resized to count and results[i] set to the ascending ids
+		// of the keywords matching texts[i]; the vectors are reused, so a warm
+		// cache and results make a batch allocation free.
+		template<typename Text>
+		void match_batch(const Text* texts, size_t count, std::vector<std::vector<unsigned>>& results) {
+			results.resize(count);
+			d_batch_states.assign(count, d_start);
+			d_batch_active.clear();
+			for (size_t i = 0; i < count; ++i) {
+				auto literals = d_trie->find_literal(texts[i].data(), static_cast<size_t>(texts[i].size()));
+				results[i].assign(literals.first, literals.second);
+				if (texts[i].size() != 0) {
+					d_batch_active.push_back(i);
+					prefetch_transition(d_start, texts[i].data()[0]);
+				}
+			}
+
+			for (size_t pos = 0; !d_batch_active.empty(); ++pos) {
+				size_t kept = 0;
+				for (size_t k = 0; k < d_batch_active.size(); ++k) {
+					size_t i = d_batch_active[k];
+					const CharType* text = texts[i].data();
+					CharType c = d_trie->normalise(text[pos]);
+					dfa_state_id next = cached_transition(d_batch_states[i], c);
+					if (next == unknown) {
+						next = add_transition(d_batch_states[i], c);
+						if (next == unknown) {
+							finish_batch_on_nfa(texts, pos, kept, k, results);
+							return;
+						}
+					}
+					d_batch_states[i] = next;
+					if (pos + 1 == static_cast<size_t>(texts[i].size())) {
+						add_ids(d_states[next].accepts, results[i]);
+					} else if (next != dead_state) {
+						prefetch_transition(next, text[pos + 1]);
+						d_batch_active[kept++] = i;
+					}
+				}
+				d_batch_active.resize(kept);
+			}
+		}
+
+	private:
+		// The cache has to be flushed part way through a batch round: texts
+		// d_batch_active[0, advanced) have consumed position pos, those from
+		// d_batch_active[waiting] on have not. Finishes all of them on the NFA.
+		template<typename Text>
+		void finish_batch_on_nfa(const Text* texts, size_t pos, size_t advanced, size_t waiting,
+			std::vector<std::vector<unsigned>>& results) {
+			std::vector<std::pair<size_t, size_t>> pending;  // text, next position
+			std::vector<item_collection> pending_items;
+			for (size_t k = 0; k < d_batch_active.size(); ++k) {
+				if (k < advanced || k >= waiting) {
+					size_t i = d_batch_active[k];
+					pending.push_back(std::make_pair(i, k < advanced ? pos + 1 : pos));
+					pending_items.push_back(d_states[d_batch_states[i]].items);
+				}
+			}
+			reset();
+			item_collection next_items;
+			for (size_t p = 0; p < pending.size(); ++p) {
+				const Text& text = texts[pending[p].first];
+				item_collection& items = pending_items[p];
+				for (size_t j = pending[p].second; j < static_cast<size_t>(text.size()) && !items.empty(); ++j) {
+					step(items, d_trie->normalise(text.data()[j]), next_items);
+					items.swap(next_items);
+				}
+				add_ids(accepts(items), results[pending[p].first]);
+			}
+			d_batch_active.clear();
+		}
+
+		static void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+			__builtin_prefetch(address);
+#else
+			(void)address;
+#endif
+		}
+
+		void prefetch_transition(dfa_state_id cur, CharType c) const {
+			auto code = static_cast<typename std::make_unsigned<CharType>::type>(d_trie->normalise(c));
+			if (code < table_size) {
+				prefetch(d_states[cur].next.get() + d_classes.get(static_cast<unsigned char>(code)));
+			}
+		}
+
+		// Bytes the NFA can tell apart: those labelling a transition or inside
+		// a compressed run, plus the wildcard syntax, since '+' stops at '.'.
+		// A transition computed for one byte of a class holds for all of them.
+		static byte_classes make_classes(const trie_type& trie) {
+			typedef typename std::make_unsigned<CharType>::type code_type;
+			byte_classes result;
+			auto add = [&result](CharType c) {
+				auto code = static_cast<code_type>(c);
+				if (code < table_size) {
+					result.add(static_cast<unsigned char>(code));
+				}
+			};
+			add('.');
+			add('+');
+			add('#');
+			for (CharType c : trie.d_labels) {
+				add(c);
+			}
+			for (CharType c : trie.d_runs) {
+				add(c);
+			}
+			return result;
+		}
+
+		static item make_item(state_id id, std::uint32_t offset) {
+			return (static_cast<item>(id) << 32) | static_cast<item>(offset);
+		}
+		static state_id item_state(item i) { return static_cast<state_id>(i >> 32); }
+		static std::uint32_t item_offset(item i) { return static_cast<std::uint32_t>(i & 0xffffffffu); }
+
+		void reset() {
+			if (!d_states.empty()) {
+				++d_num_flushes;
+			}
+			d_states.clear();
+			d_cache.clear();
+			d_wide_transitions = edge_table();
+			d_memory_usage = 0;
+			add_state(item_collection());
+			d_start = add_state(item_collection(1, make_item(0, 0)));
+		}
+
+		dfa_state_id cached_transition(dfa_state_id cur, CharType c) const {
+			auto code = static_cast<typename std::make_unsigned<CharType>::type>(c);
+			if (code < table_size) {
+				return d_states[cur].next[d_classes.get(static_cast<unsigned char>(code))];
+			}
+			return d_wide_transitions.find(cur, static_cast<std::uint32_t>(code));
+		}
+
+		// Computes and caches the successor of cur on c. Returns unknown when
+		// the cache had to be flushed, leaving cur's items to the caller.
+		dfa_state_id add_transition(dfa_state_id cur, CharType c) {
+			item_collection next_items;
+			step(d_states[cur].items, c, next_items);
+			auto found = d_cache.find(next_items);
+			dfa_state_id next = (found != d_cache.end()) ? found->second : unknown;
+			if (next == unknown) {
+				if (d_memory_usage + state_cost(next_items) > d_memory_budget) {
+					return unknown;
+				}
+				next = add_state(next_items);
+			}
+			auto code = static_cast<typename std::make_unsigned<CharType>::type>(c);
+			if (code < table_size) {
+				d_states[cur].next[d_classes.get(static_cast<unsigned char>(code))] = next;
+			} else {
+				d_wide_transitions.insert(cur, static_cast<std::uint32_t>(code), next);
+			}
+			return next;
+		}
+
+		size_t state_cost(const item_collection& items) const {
+			return sizeof(dfa_state) + d_classes.num_classes() * sizeof(dfa_state_id) + items.size() * sizeof(item) * 2;
+		}
+
+		dfa_state_id add_state(const item_collection& items) {
+			auto id = static_cast<dfa_state_id>(d_states.size());
+			d_states.push_back(dfa_state());
+			dfa_state& s = d_states.back();
+			s.items = items;
+			s.accepts = accepts(items);
+			s.next.reset(new dfa_state_id[d_classes.num_classes()]);
+			std::fill(s.next.get(), s.next.get() + d_classes.num_classes(), (id == dead_state) ? dead_state : unknown);
+			d_cache[items] = id;
+			d_memory_usage += state_cost(items);
+			return id;
+		}
+
+		// One NFA step, the same transitions basic_frozen_trie::parse_text takes.
+		void step(const item_collection& items, CharType c, item_collection& next_items) const {
+			typedef typename trie_type::node node;
+			next_items.clear();
+			for (auto i : items) {
+				const node& n = d_trie->d_nodes[item_state(i)];
+				auto offset = item_offset(i);
+				if (offset < n.run_length) {
+					if (d_trie->d_runs[n.first_run + offset] == c) {
+						next_items.push_back(make_item(item_state(i), offset + 1));
+					}
+					continue;
+				}
+				auto next = d_trie->get_state(item_state(i), c);
+				if (next != trie_type::npos) {
+					next_items.push_back(make_item(next, 0));
+				}
+				if (!(n.value == '+' && c == '.') && n.plus != trie_type::npos) {
+					next_items.push_back(make_item(n.plus, 0));
+				}
+				if (n.hash != trie_type::npos) {
+					next_items.push_back(make_item(n.hash, 0));
+				}
+			}
+			std::sort(next_items.begin(), next_items.end());
+			next_items.erase(std::unique(next_items.begin(), next_items.end()), next_items.end());
+		}
+
+		// Pattern ids emitted if the text ends with these items active.
+		std::vector<unsigned> accepts(const item_collection& items) const {
+			std::vector<unsigned> result;
+			for (auto i : items) {
+				auto id = item_state(i);
+				const auto& n = d_trie->d_nodes[id];
+				if (item_offset(i) < n.run_length) {
+					continue;
+				}
+				if (d_trie->accepts_at_end(id)) {
+					result.insert(result.end(), d_trie->d_emits.begin() + n.first_emit, d_trie->d_emits.begin() + n.first_emit + n.num_emits);
+				}
+			}
+			std::sort(result.begin(), result.end());
+			result.erase(std::unique(result.begin(), result.end()), result.end());
+			return result;
+		}
+
+		void store_emits(size_t pos, const std::vector<unsigned>& ids, emit_collection& collected_emits) const {
+			for (auto id : ids) {
+				const string_type& keyword = d_trie->get_keyword(id);
+				collected_emits[emit_type(pos - keyword.size() + 1, pos, keyword, id)] = true;
+			}
+		}
+
+		// The automaton leaves keywords without wildcards to the literal index.
+		void store_literals(const string_type& text, emit_collection& collected_emits) const {
+			auto literals = d_trie->find_literal(text.data(), text.length());
+			for (const unsigned* id = literals.first; id != literals.second; ++id) {
+				collected_emits[emit_type(0, text.length() - 1, d_trie->get_keyword(*id), *id)] = true;
+			}
+		}
+
+		// Adds the ascending ids to the ascending result, which usually holds
+		// no literal match; sorting in place keeps a warm batch allocation free.
+		static void add_ids(const std::vector<unsigned>& ids, std::vector<unsigned>& result) {
+			bool had_ids = !result.empty();
+			result.insert(result.end(), ids.begin(), ids.end());
+			if (had_ids) {
+				std::sort(result.begin(), result.end());
+			}
+		}
+	};
+
+	// class parallel_matcher
+	//
+	// Splits large batches of texts across a pool of worker threads. A batch
+	// is cut into chunks that are dealt round robin onto per-worker queues;
+	// a worker takes chunks from the front of its own queue and, once that
+	// is empty, steals from the back of the others, so a run of expensive
+	// topics on one worker does not hold up the batch. Each worker keeps its
+	// own match_context and writes the result of text i to results[i], so
+	// results come back in input order without a merge step.
+	//
+	// Trie is basic_frozen_trie or basic_trie. Only its const match_ids is
+	// called, so the trie must not be modified while a batch is running.
+	// match_batch itself must not be called from several threads at once.
+	template<typename Trie>
+	class parallel_matcher {
+	public:
+		typedef Trie                                trie_type;
+		typedef typename Trie::match_context        context_type;
+		typedef std::vector<std::vector<unsigned>>  result_collection;
+
+	private:
+		typedef std::pair<size_t, size_t> chunk; // [first, last) texts
+
+		struct worker {
+			std::mutex        lock;   // guards chunks
+			std::deque<chunk> chunks;
+			context_type      context;
+			std::thread       thread;
+		};
+
+		enum : size_t {
+			chunks_per_worker = 8,
+			min_chunk_size    = 16,
+		};
+
+		const trie_type*                                     d_trie;
+		std::vector<std::unique_ptr<worker>>                 d_workers;
+		std::function<void(size_t, size_t, context_type&)>   d_task;
+		std::mutex                                           d_lock;
+		std::condition_variable                              d_wake;
+		std::condition_variable                              d_done;
+		size_t                                               d_generation;
+		std::atomic<size_t>                                  d_pending;
+		bool                                                 d_stop;
+
+	public:
+		// Starts num_threads workers, or one per hardware thread when 0.
+		explicit parallel_matcher(const trie_type& trie, unsigned num_threads = 0)
+			: d_trie(&trie)
+			, d_workers()
+			, d_task()
+			, d_lock()
+			, d_wake()
+			, d_done()
+			, d_generation(0)
+			, d_pending(0)
+			, d_stop(false)
+		{
+			if (num_threads == 0) {
+				num_threads = std::max(1u, std::thread::hardware_concurrency());
+			}
+			for (unsigned i = 0; i < num_threads; ++i) {
+				d_workers.push_back(std::unique_ptr<worker>(new worker()));
+			}
+			for (size_t i = 0; i < d_workers.size(); ++i) {
+				d_workers[i]->thread = std::thread(&parallel_matcher::run, this, i);
+			}
+		}
+
+		parallel_matcher(const parallel_matcher&) = delete;
+		parallel_matcher& operator=(const parallel_matcher&) = delete;
+
+		~parallel_matcher() {
+			{
+				std::lock_guard<std::mutex> guard(d_lock);
+				d_stop = true;
+			}
+			d_wake.notify_all();
+			for (auto& w : d_workers) {
+				w->thread.join();
+			}
+		}
+
+		size_t num_threads() const { return d_workers.size(); }
+
+		// Matches texts[0, count) and sets results[i] to the ascending ids of
+		// the keywords matching texts[i]. Text is anything with data() and
+		// size(). Blocks until the whole batch is done.
+		template<typename Text>
+		void match_batch(const Text* texts, size_t count, result_collection& results) {
+			results.resize(count);
+			if (count == 0) {
+				return;
+			}
+			const trie_type& trie = *d_trie;
+			d_task = [&trie, texts, &results](size_t first, size_t last, context_type& ctx) {
+				for (size_t i = first; i < last; ++i) {
+					const auto& ids = trie.match_ids(texts[i].data(), texts[i].size(), ctx);
+					results[i].assign(ids.begin(), ids.end());
+				}
+			};
+
+			size_t chunk_size = std::max<size_t>(min_chunk_size, count / (d_workers.size() * chunks_per_worker));
+			size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+			d_pending = num_chunks;
+			for (size_t c = 0; c < num_chunks; ++c) {
+				worker& w = *d_workers[c % d_workers.size()];
+				std::lock_guard<std::mutex> guard(w.lock);
+				w.chunks.push_back(chunk(c * chunk_size, std::min(count, (c + 1) * chunk_size)));
+			}
+
+			std::unique_lock<std::mutex> lock(d_lock);
+			++d_generation;
+			d_wake.notify_all();
+			d_done.wait(lock, [this] { return d_pending == 0; });
+		}
+
+	private:
+		void run(size_t self) {
+			size_t generation = 0;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(d_lock);
+					d_wake.wait(lock, [&] { return d_stop || d_generation != generation; });
+					if (d_stop) {
+						return;
+					}
+					generation = d_generation;
+				}
+
+				chunk next;
+				while (take(self, next) || steal(self, next)) {
+					d_task(next.first, next.second, d_workers[self]->context);
+					if (d_pending.fetch_sub(1) == 1) {
+						std::lock_guard<std::mutex> guard(d_lock);
+						d_done.notify_all();
+					}
+				}
+			}
+		}
+
+		bool take(size_t self, chunk& result) {
+			worker& w = *d_workers[self];
+			std::lock_guard<std::mutex> guard(w.lock);
+			if (w.chunks.empty()) {
+				return false;
+			}
+			result = w.chunks.front();
+			w.chunks.pop_front();
+			return true;
+		}
+
+		bool steal(size_t self, chunk& result) {
+			for (size_t i = 1; i < d_workers.size(); ++i) {
+				worker& victim = *d_workers[(self + i) % d_workers.size()];
+				std::lock_guard<std::mutex> guard(victim.lock);
+				if (!victim.chunks.empty()) {
+					result = victim.chunks.back();
+					victim.chunks.pop_back();
+					return true;
+				}
+			}
+			return false;
 		}
 	};
 
 	typedef basic_trie<char>     trie;
 	typedef basic_trie<wchar_t>  wtrie;
 
+	typedef basic_frozen_trie<char>     frozen_trie;
+	typedef basic_frozen_trie<wchar_t>  wfrozen_trie;
+
+	typedef basic_topic_trie<char>      topic_trie;
+	typedef basic_topic_trie<wchar_t>   wtopic_trie;
+
+	typedef basic_lazy_dfa<char>        lazy_dfa;
+	typedef basic_lazy_dfa<wchar_t>     wlazy_dfa;
+
 
 } // namespace aho_corasick
 
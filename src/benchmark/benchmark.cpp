@@ -52,7 +52,7 @@ size_t bench_naive(vector<string> text_strings, vector<string> patterns) {
 		for (auto& pattern : patterns) {
 			size_t pos = text.find(pattern);
 			while (pos != text.npos) {
-				pos = text.find(pattern, pos);
+				pos = text.find(pattern, pos + 1);
 				count++;
 			}
 		}
@@ -60,7 +60,8 @@ size_t bench_naive(vector<string> text_strings, vector<string> patterns) {
 	return count;
 }
 
-size_t bench_aho_corasick(vector<string> text_strings, trie& t) {
+template<typename Trie>
+size_t bench_aho_corasick(vector<string> text_strings, Trie& t) {
 	size_t count = 0;
 	for (auto& text : text_strings) {
 		auto matches = t.parse_text(text);
@@ -91,31 +92,18 @@ Results:
 Process finished with exit code 0
  */
 
-int main(int argc, char** argv) {
-	cout << "*** Aho-Corasick Benchmark ***" << endl;
-
-	cout << "Generating input text ...";
-	set<string> input_strings;
-	while (input_strings.size() < 10) {
-		input_strings.insert(gen_str(256));
-	}
-	vector<string> input_vector(input_strings.begin(), input_strings.end());
-	cout << " done" << endl;
-
-	cout << "Generating search patterns ...";
-	set<string> patterns;
-	while (patterns.size() < 1000000) {
-		patterns.insert(gen_str(8));
-	}
-	vector<string> pattern_vector(patterns.begin(), patterns.end());
-	cout << " done" << endl;
-
+template<typename Trie>
+int run(const vector<string>& input_vector, const vector<string>& pattern_vector) {
 	cout << "Generating trie ...";
-	trie t;
-	for (auto& pattern : patterns) {
+	auto build_start = chrono::high_resolution_clock::now();
+	Trie t;
+	t.unanchored();
+	for (auto& pattern : pattern_vector) {
 		t.insert(pattern);
 	}
-	cout << " done" << endl;
+	t.build(); // links the failure states, which would otherwise land in the first loop
+	auto build_time = chrono::high_resolution_clock::now() - build_start;
+	cout << " done (" << chrono::duration_cast<chrono::milliseconds>(build_time).count() << "ms)" << endl;
 
 	map<size_t, tuple<chrono::high_resolution_clock::duration, chrono::high_resolution_clock::duration>> timings;
 
@@ -148,5 +136,109 @@ int main(int argc, char** argv) {
 		cout << endl;
 	}
 
+	auto teardown_start = chrono::high_resolution_clock::now();
+	t.clear();
+	auto teardown_time = chrono::high_resolution_clock::now() - teardown_start;
+	cout << "Teardown: " << chrono::duration_cast<chrono::milliseconds>(teardown_time).count() << "ms" << endl;
+
+	return 0;
+}
+
+template<typename Trie>
+chrono::high_resolution_clock::duration time_matches(const vector<string>& input_vector, Trie& t, size_t& count) {
+	count = 0;
+	auto start_time = chrono::high_resolution_clock::now();
+	for (size_t loop = 0; loop < 100; ++loop) {
+		for (auto& text : input_vector) {
+			t.parse_text(text, [&count](unsigned, size_t, size_t) { ++count; });
+		}
+	}
+	return chrono::high_resolution_clock::now() - start_time;
+}
+
+// Failure walk against the full_dfa transition table for growing keyword
+// sets. The table is all the extra memory the dfa needs; it is skipped once
+// it would outgrow dfa_budget.
+int run_dfa(const vector<string>& input_vector) {
+	const size_t dfa_budget = size_t(1) << 30;
+	for (size_t num_patterns : { 10000, 100000, 1000000 }) {
+		set<string> patterns;
+		while (patterns.size() < num_patterns) {
+			patterns.insert(gen_str(8));
+		}
+		trie t;
+		t.unanchored();
+		t.insert(patterns.begin(), patterns.end());
+		t.build();
+
+		size_t walk_count = 0;
+		auto walk_time = time_matches(input_vector, t, walk_count);
+		// one column per distinct pattern byte, plus one for every other byte
+		set<char> pattern_bytes;
+		for (auto& pattern : patterns) {
+			pattern_bytes.insert(pattern.begin(), pattern.end());
+		}
+		size_t table_size = t.num_states() * (pattern_bytes.size() + 1) * sizeof(uint32_t);
+		cout << num_patterns << " patterns, " << t.num_states() << " states: walk ";
+		cout << chrono::duration_cast<chrono::microseconds>(walk_time).count() << "us";
+		if (table_size > dfa_budget) {
+			cout << ", dfa skipped (table would take " << (table_size >> 20) << "MB)" << endl;
+			continue;
+		}
+
+		t.full_dfa();
+		auto build_start = chrono::high_resolution_clock::now();
+		t.build();
+		auto build_time = chrono::high_resolution_clock::now() - build_start;
+		size_t dfa_count = 0;
+		auto dfa_time = time_matches(input_vector, t, dfa_count);
+		cout << ", dfa " << chrono::duration_cast<chrono::microseconds>(dfa_time).count() << "us";
+		cout << " (" << (t.transition_table_size() >> 20) << "MB table, built in ";
+		cout << chrono::duration_cast<chrono::milliseconds>(build_time).count() << "ms)";
+		if (walk_count != dfa_count) {
+			cout << " failed";
+		}
+		cout << endl;
+	}
 	return 0;
-}
\ No newline at end of file
+}
+
+// usage: benchmark [map|vector|dense|hash|adaptive|hybrid|dfa] [number of patterns]
+int main(int argc, char** argv) {
+	string transitions = (argc > 1) ? argv[1] : "map";
+	size_t num_patterns = (argc > 2) ? stoul(argv[2]) : 1000000;
+
+	cout << "*** Aho-Corasick Benchmark ***" << endl;
+	cout << "Transitions: " << transitions << ", patterns: " << num_patterns << endl;
+
+	cout << "Generating input text ...";
+	set<string> input_strings;
+	while (input_strings.size() < 10) {
+		input_strings.insert(gen_str(256));
+	}
+	vector<string> input_vector(input_strings.begin(), input_strings.end());
+	cout << " done" << endl;
+
+	if (transitions == "dfa")
+		return run_dfa(input_vector);
+
+	cout << "Generating search patterns ...";
+	set<string> patterns;
+	while (patterns.size() < num_patterns) {
+		patterns.insert(gen_str(8));
+	}
+	vector<string> pattern_vector(patterns.begin(), patterns.end());
+	cout << " done" << endl;
+
+	if (transitions == "vector")
+		return run<ac::basic_trie<char, ac::sorted_vector_transitions>>(input_vector, pattern_vector);
+	if (transitions == "dense")
+		return run<ac::basic_trie<char, ac::dense_transitions>>(input_vector, pattern_vector);
+	if (transitions == "hash")
+		return run<ac::basic_trie<char, ac::hash_transitions>>(input_vector, pattern_vector);
+	if (transitions == "adaptive")
+		return run<ac::basic_trie<char, ac::adaptive_transitions>>(input_vector, pattern_vector);
+	if (transitions == "hybrid")
+		return run<ac::basic_trie<char, ac::hybrid_transitions>>(input_vector, pattern_vector);
+	return run<trie>(input_vector, pattern_vector);
+}
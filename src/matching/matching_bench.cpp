@@ -25,15 +25,42 @@
 #include <iostream>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <algorithm>
 #include <iterator>
 #include <sstream>
+#include <cstdlib>
+#include <new>
 
 using namespace std;
 namespace ac = aho_corasick;
 using trie = ac::trie;
 
+// every heap allocation in the process is counted, so the matching entry
+// points can be compared by allocations per topic
+static size_t num_allocations = 0;
+
+void* operator new(size_t size) {
+  ++num_allocations;
+  if (void* p = malloc(size ? size : 1))
+    return p;
+  throw bad_alloc();
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+  ++num_allocations;
+  return malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
 // taken from: https://github.com/KolorowyAleksander/mailbox/blob/master/include/utilities.h
 namespace utilities {
 
@@ -128,7 +155,61 @@ size_t bench_naive(vector<string> text_strings, vector<string> patterns) {
   return count;
 }
 
-size_t bench_aho_corasick(vector<string> text_strings, trie& t) {
+template<typename Trie>
+size_t bench_aho_corasick(vector<string> text_strings, Trie& t) {
+  size_t count = 0;
+  for (auto& text : text_strings) {
+    auto matches = t.parse_text(text);
+    if (!matches.empty())
+      count ++;
+  }
+  return count;
+}
+
+size_t bench_frozen(vector<string> text_strings, const ac::frozen_trie& t) {
+  size_t count = 0;
+  for (auto& text : text_strings) {
+    auto matches = t.parse_text(text);
+    if (!matches.empty())
+      count ++;
+  }
+  return count;
+}
+
+template<typename Trie>
+size_t bench_match_context(vector<string> text_strings, const Trie& t, typename Trie::match_context& ctx) {
+  size_t count = 0;
+  for (auto& text : text_strings) {
+    auto& matches = t.match(text.data(), text.size(), ctx);
+    if (!matches.empty())
+      count ++;
+  }
+  return count;
+}
+
+template<typename Trie>
+size_t bench_handler(vector<string> text_strings, const Trie& t, typename Trie::match_context& ctx) {
+  size_t count = 0;
+  for (auto& text : text_strings) {
+    size_t matches = 0;
+    t.parse_text(text.data(), text.size(), [&](unsigned, size_t, size_t) { ++matches; }, ctx);
+    if (matches != 0)
+      count ++;
+  }
+  return count;
+}
+
+template<typename Trie>
+size_t bench_matches_any(vector<string> text_strings, const Trie& t, typename Trie::match_context& ctx) {
+  size_t count = 0;
+  for (auto& text : text_strings) {
+    if (t.matches_any(text.data(), text.size(), ctx))
+      count ++;
+  }
+  return count;
+}
+
+size_t bench_topic(vector<string> text_strings, const ac::topic_trie& t) {
   size_t count = 0;
   for (auto& text : text_strings) {
     auto matches = t.parse_text(text);
@@ -138,30 +219,240 @@ size_t bench_aho_corasick(vector<string> text_strings, trie& t) {
   return count;
 }
 
+size_t bench_lazy_dfa(vector<string> text_strings, ac::lazy_dfa& dfa) {
+  size_t count = 0;
+  for (auto& text : text_strings) {
+    auto matches = dfa.parse_text(text);
+    if (!matches.empty())
+      count ++;
+  }
+  return count;
+}
+
+// Segments are never empty: the topic trie lets '+' and '#' match an empty
+// segment and the character engines do not, so only such topics let every
+// engine be checked against the others.
+string gen_topic() {
+  std::string input = "ptr.";
+  for(int i = 0; i < 5; i++)
+  {
+    input.append(gen_str((rand() % 7)+3));
+    input.append(".");
+  }
+  input.pop_back();
+  return input;
+}
 
+template<typename Function>
+chrono::high_resolution_clock::duration time_it(Function f, size_t& count) {
+  auto start_time = chrono::high_resolution_clock::now();
+  count = f();
+  return chrono::high_resolution_clock::now() - start_time;
+}
+
+// Heap allocations per topic made by f(topic) once it has seen every topic.
+template<typename Function>
+double allocations_per_topic(Function f, const vector<string>& input_vector) {
+  for (auto& text : input_vector) {
+    f(text);
+  }
+  size_t before = num_allocations;
+  for (auto& text : input_vector) {
+    f(text);
+  }
+  return double(num_allocations - before) / input_vector.size();
+}
+
+// Topics per second through lazy_dfa::match_batch for a few batch sizes,
+// on a warm cache large enough not to flush.
+void run_batches(const ac::frozen_trie& frozen) {
+  using clock = chrono::high_resolution_clock;
+
+  vector<string> topics;
+  for (size_t i = 0; i < 20000; ++i) {
+    topics.push_back(gen_topic());
+  }
+
+  cout << "Batch throughput:";
+  for (size_t batch : { 1, 8, 32 }) {
+    ac::lazy_dfa dfa(frozen, 512 * 1024 * 1024);
+    vector<vector<unsigned>> results;
+    size_t elapsed_us = 0;
+    for (size_t loop = 0; loop < 4; ++loop) {
+      auto start_time = clock::now();
+      for (size_t first = 0; first + batch <= topics.size(); first += batch) {
+        dfa.match_batch(topics.data() + first, batch, results);
+      }
+      if (loop > 0) {
+        elapsed_us += chrono::duration_cast<chrono::microseconds>(clock::now() - start_time).count();
+      }
+    }
+    cout << " " << batch << ": " << topics.size() * 3 * 1000000 / max<size_t>(elapsed_us, 1) << "/s";
+  }
+  cout << endl;
+}
+
+void run_threads(const ac::frozen_trie& frozen) {
+  using clock = chrono::high_resolution_clock;
+
+  vector<string> topics;
+  for (size_t i = 0; i < 200000; ++i) {
+    topics.push_back(gen_topic());
+  }
+
+  unsigned max_threads = max(4u, thread::hardware_concurrency());
+  cout << "Parallel throughput (" << thread::hardware_concurrency() << " hardware threads):";
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    ac::parallel_matcher<ac::frozen_trie> matcher(frozen, threads);
+    vector<vector<unsigned>> results;
+    size_t elapsed_us = 0;
+    for (size_t loop = 0; loop < 4; ++loop) {
+      auto start_time = clock::now();
+      matcher.match_batch(topics.data(), topics.size(), results);
+      if (loop > 0) {
+        elapsed_us += chrono::duration_cast<chrono::microseconds>(clock::now() - start_time).count();
+      }
+    }
+    cout << " " << threads << ": " << topics.size() * 3 * 1000000 / max<size_t>(elapsed_us, 1) << "/s";
+  }
+  cout << endl;
+}
+
+template<typename Trie>
+int run(const vector<string>& input_vector, const vector<string>& pattern_vector) {
+  using clock = chrono::high_resolution_clock;
+
+  cout << "Generating trie ...";
+  auto build_start = clock::now();
+  Trie t;
+  for (auto& pattern : pattern_vector) {
+    t.insert(pattern);
+  }
+  auto build_time = clock::now() - build_start;
+  cout << " done (" << chrono::duration_cast<chrono::milliseconds>(build_time).count() << "ms)" << endl;
+
+  cout << "Freezing trie ...";
+  auto frozen = t.freeze();
+  cout << " done (" << frozen.num_states() << " states)" << endl;
+  t.two_byte_stride();
+  auto strided = t.freeze();
+  cout << "Two byte stride: " << strided.num_pair_transitions() << " pair transitions" << endl;
+
+  ac::lazy_dfa dfa(frozen);
+
+  cout << "Generating topic trie ...";
+  build_start = clock::now();
+  ac::topic_trie topics;
+  topics.insert(pattern_vector.begin(), pattern_vector.end());
+  build_time = clock::now() - build_start;
+  cout << " done (" << chrono::duration_cast<chrono::milliseconds>(build_time).count() << "ms, ";
+  cout << topics.num_states() << " states, " << topics.num_segments() << " segments)" << endl;
+
+  typename Trie::match_context trie_ctx;
+  ac::frozen_trie::match_context frozen_ctx;
+  vector<string> names = { "naive", "ac", "frozen", "topic", "dfa", "frozen ctx", "frozen any", "frozen handler", "frozen stride" };
+  map<size_t, vector<clock::duration>> timings;
+
+  cout << "Running ";
+  cout << boolalpha;
+  for (size_t i = 10; i > 0; --i) {
+    cout << ".";
+    vector<size_t> counts(names.size());
+    vector<clock::duration> times;
+    times.push_back(time_it([&] { return bench_naive(input_vector, pattern_vector); }, counts[0]));
+    times.push_back(time_it([&] { return bench_aho_corasick(input_vector, t); }, counts[1]));
+    times.push_back(time_it([&] { return bench_frozen(input_vector, frozen); }, counts[2]));
+    times.push_back(time_it([&] { return bench_topic(input_vector, topics); }, counts[3]));
+    times.push_back(time_it([&] { return bench_lazy_dfa(input_vector, dfa); }, counts[4]));
+    times.push_back(time_it([&] { return bench_match_context(input_vector, frozen, frozen_ctx); }, counts[5]));
+    times.push_back(time_it([&] { return bench_matches_any(input_vector, frozen, frozen_ctx); }, counts[6]));
+    times.push_back(time_it([&] { return bench_handler(input_vector, frozen, frozen_ctx); }, counts[7]));
+    times.push_back(time_it([&] { return bench_match_context(input_vector, strided, frozen_ctx); }, counts[8]));
+
+    if (counts[0] != counts[1] || counts[1] != counts[2] || counts[2] != counts[3] || counts[2] != counts[4]
+        || counts[2] != counts[5] || counts[2] != counts[6] || counts[2] != counts[7] || counts[2] != counts[8]) {
+      cout << "failed" << endl;
+    }
+
+    timings[i] = times;
+  }
+  cout << " done" << endl;
+  cout << "Lazy DFA: " << dfa.num_states() << " states, " << dfa.memory_usage() / 1024 << "KB, ";
+  cout << dfa.num_flushes() << " flushes" << endl;
+
+  cout << "Allocations per topic: ";
+  cout << "ac " << allocations_per_topic([&](const string& text) { t.parse_text(text); }, input_vector);
+  cout << ", frozen " << allocations_per_topic([&](const string& text) { frozen.parse_text(text); }, input_vector);
+  cout << ", ac ctx " << allocations_per_topic([&](const string& text) { t.match(text, trie_ctx); }, input_vector);
+  cout << ", frozen ctx " << allocations_per_topic([&](const string& text) { frozen.match(text, frozen_ctx); }, input_vector);
+  cout << endl;
+
+  run_batches(frozen);
+  run_threads(frozen);
+
+  cout << "Results: " << endl;
+  for (auto& i : timings) {
+    cout << "  loop #" << i.first;
+    for (size_t j = 0; j < names.size(); ++j) {
+      cout << ", " << names[j] << ": " << chrono::duration_cast<chrono::microseconds>(i.second[j]).count() << "us";
+    }
+    cout << endl;
+  }
+
+  return 0;
+}
+
+// Overlapping '#' patterns against ever deeper topics. Each '#' can absorb
+// any number of segments, so the number of paths through the automaton grows
+// combinatorially with depth while the number of distinct states does not.
+int run_pathological() {
+  trie t;
+  for (int i = 0; i < 100; ++i) {
+    t.insert("#.#.#.#.s" + to_string(i) + "e");
+  }
+  auto frozen = t.freeze();
+  ac::frozen_trie::match_context ctx;
+  cout << "Patterns: 100 x #.#.#.#.s<i>e, " << frozen.num_states() << " frozen states" << endl;
+
+  for (size_t depth = 4; depth <= 32; depth += 4) {
+    string topic;
+    for (size_t i = 0; i < depth; ++i) {
+      topic += "ab.";
+    }
+    topic += "s7e";
+
+    size_t count = 0;
+    auto trie_time = time_it([&] { return t.parse_text(topic).size(); }, count);
+    auto frozen_time = time_it([&] { return frozen.match(topic, ctx).size(); }, count);
+    cout << "  depth " << depth + 1 << ": trie " << chrono::duration_cast<chrono::microseconds>(trie_time).count();
+    cout << "us, frozen " << chrono::duration_cast<chrono::microseconds>(frozen_time).count() << "us, ";
+    cout << count << " match, peak active " << ctx.peak_active() << endl;
+  }
+  return 0;
+}
+
+// usage: matching_bench [map|vector|dense|hash|adaptive|hybrid] [number of patterns]
+//        matching_bench --pathological
 int main(int argc, char** argv) {
+  string transitions = (argc > 1) ? argv[1] : "map";
+  if (transitions == "--pathological")
+    return run_pathological();
+  size_t num_patterns = (argc > 2) ? stoul(argv[2]) : 100000;
+
   cout << "*** Aho-Corasick Matching Test ***" << endl;
+  cout << "Transitions: " << transitions << ", patterns: " << num_patterns << endl;
 
   cout << "Generating input text ...";
   set<string> input_strings;
   while (input_strings.size() < 10) {
-    std::string input = "ptr.";
-    for(int i = 0; i < 5; i++)
-    {
-      input.append(gen_str((rand() % 7)+3));
-      input.append(".");
-    }
-    input.pop_back();
-    input_strings.insert(input);
-
-    //cout << "pattern: " << input << endl;
+    input_strings.insert(gen_topic());
   }
   vector<string> input_vector(input_strings.begin(), input_strings.end());
   cout << " done" << endl;
 
   cout << "Generating search patterns ...";
   set<string> patterns;
-  while (patterns.size() < 100000) {
+  while (patterns.size() < num_patterns) {
     std::string pattern = "ptr.";
     for(int i = 0; i < 5; i++)
     {
@@ -184,44 +475,15 @@ int main(int argc, char** argv) {
   vector<string> pattern_vector(patterns.begin(), patterns.end());
   cout << " done" << endl;
 
-  cout << "Generating trie ...";
-  trie t;
-  for (auto& pattern : patterns) {
-    t.insert(pattern);
-  }
-  cout << " done" << endl;
-
-  map<size_t, tuple<chrono::high_resolution_clock::duration, chrono::high_resolution_clock::duration>> timings;
-
-  cout << "Running ";
-  cout << boolalpha;
-  for (size_t i = 10; i > 0; --i) {
-    cout << ".";
-    auto start_time = chrono::high_resolution_clock::now();
-    size_t count_1 = bench_naive(input_vector, pattern_vector);
-    auto end_time = chrono::high_resolution_clock::now();
-    auto time_1 = end_time - start_time;
-
-    start_time = chrono::high_resolution_clock::now();
-    size_t count_2 = bench_aho_corasick(input_vector, t);
-    end_time = chrono::high_resolution_clock::now();
-    auto time_2 = end_time - start_time;
-
-    if (count_1 != count_2) {
-      cout << "failed" << endl;
-    }
-
-    timings[i] = make_tuple(time_1, time_2);
-  }
-  cout << " done" << endl;
-
-  cout << "Results: " << endl;
-  for (auto& i : timings) {
-    cout << "  loop #" << i.first;
-    cout << ", naive: " << chrono::duration_cast<chrono::milliseconds>(get<0>(i.second)).count();
-    cout << "ms, ac: " << chrono::duration_cast<chrono::milliseconds>(get<1>(i.second)).count() << "ms";
-    cout << endl;
-  }
-
-  return 0;
-}
\ No newline at end of file
+  if (transitions == "vector")
+    return run<ac::basic_trie<char, ac::sorted_vector_transitions>>(input_vector, pattern_vector);
+  if (transitions == "dense")
+    return run<ac::basic_trie<char, ac::dense_transitions>>(input_vector, pattern_vector);
+  if (transitions == "hash")
+    return run<ac::basic_trie<char, ac::hash_transitions>>(input_vector, pattern_vector);
+  if (transitions == "adaptive")
+    return run<ac::basic_trie<char, ac::adaptive_transitions>>(input_vector, pattern_vector);
+  if (transitions == "hybrid")
+    return run<ac::basic_trie<char, ac::hybrid_transitions>>(input_vector, pattern_vector);
+  return run<trie>(input_vector, pattern_vector);
+}
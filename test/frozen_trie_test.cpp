@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2018 Christopher Gilbert.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#define CATCH_CONFIG_MAIN
+#include "../test/catch.hpp"
+#include "../test/random_topic.hpp"
+
+#include "aho_corasick/aho_corasick.hpp"
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ac = aho_corasick;
+
+namespace {
+	const std::vector<std::string> topics = {
+		"hi.mom",
+		"hi.there",
+		"hi.alex.how.are.you?",
+		"hi.james.how.are.you?",
+		"hi.james.bond.how.are.you?",
+		"im.patrick",
+		"im.patrick.bond",
+		"im.james.bond",
+		"im.not.james.bond",
+		"nothing.here",
+	};
+
+	const std::vector<std::string> patterns = {
+		"hi.#",
+		"hi.+",
+		"hi.there",
+		"hi.mom",
+		"hi.+.how.are.you?",
+		"im.james.bond",
+		"im.+.bond",
+		"im.#.bond",
+		"im.#",
+	};
+
+	std::vector<std::pair<size_t, size_t>> spans(const ac::trie::emit_collection& emits) {
+		std::vector<std::pair<size_t, size_t>> result;
+		for (const auto& e : emits) {
+			result.push_back(std::make_pair(e.first.get_start(), e.first.get_end()));
+		}
+		return result;
+	}
+
+	std::vector<std::string> keywords(const ac::trie::emit_collection& emits) {
+		std::vector<std::string> result;
+		for (const auto& e : emits) {
+			result.push_back(e.first.get_keyword());
+		}
+		return result;
+	}
+}
+
+TEST_CASE("frozen trie works as required", "[frozen_trie]") {
+	SECTION("empty trie matches nothing") {
+		ac::trie t;
+		auto f = t.freeze();
+		REQUIRE(1 == f.num_states());
+		REQUIRE(f.parse_text("hi.mom").empty());
+	}
+	SECTION("states are numbered in breadth first order") {
+		ac::trie t;
+		t.insert("ab.#");
+		t.insert("ac.#");
+		auto f = t.freeze();
+		// root, 'a', 'b' + ".", 'c' + ".", then the two '#'
+		REQUIRE(6 == f.num_states());
+		REQUIRE(1 == f.next_state(0, 'a'));
+		REQUIRE(2 == f.next_state(1, 'b'));
+		REQUIRE(3 == f.next_state(1, 'c'));
+		REQUIRE(ac::frozen_trie::npos == f.next_state(0, 'b'));
+	}
+	SECTION("frozen trie reports the same matches as the trie") {
+		ac::trie t;
+		for (const auto& p : patterns) {
+			t.insert(p);
+		}
+		auto f = t.freeze();
+		REQUIRE(patterns.size() == f.num_keywords());
+		for (const auto& topic : topics) {
+			INFO(topic);
+			REQUIRE(keywords(t.parse_text(topic)) == keywords(f.parse_text(topic)));
+		}
+	}
+	SECTION("random patterns agree with the trie") {
+		for (const auto& round : random_rounds(7)) {
+			ac::trie t;
+			for (const auto& p : round.patterns) {
+				t.insert(p);
+			}
+			auto f = t.freeze();
+			for (const auto& topic : round.topics) {
+				INFO(topic);
+				REQUIRE(keywords(t.parse_text(topic)) == keywords(f.parse_text(topic)));
+			}
+		}
+	}
+
+	SECTION("reused match context gives the same matches") {
+		for (const auto& round : random_rounds(7)) {
+			ac::trie t;
+			for (const auto& p : round.patterns) {
+				t.insert(p);
+			}
+			auto f = t.freeze();
+			ac::frozen_trie::match_context s;
+			for (const auto& topic : round.topics) {
+				INFO(topic);
+				REQUIRE(keywords(f.parse_text(topic, s)) == keywords(f.parse_text(topic)));
+			}
+			REQUIRE(s.peak_active() <= f.num_states());
+		}
+	}
+	SECTION("one match context serves several frozen tries") {
+		ac::trie small;
+		small.insert("x.#");
+		ac::trie large;
+		large.insert("+.y");
+		large.insert("x.+.z");
+		large.insert("#.z");
+		auto small_frozen = small.freeze();
+		auto large_frozen = large.freeze();
+		ac::frozen_trie::match_context ctx;
+		REQUIRE(2 == large_frozen.parse_text("x.y.z", ctx).size());
+		REQUIRE(keywords(small_frozen.parse_text("x.y", ctx)) == (std::vector<std::string> { "x.#" }));
+		REQUIRE(keywords(large_frozen.parse_text("x.y", ctx)) == (std::vector<std::string> { "+.y" }));
+		REQUIRE(small_frozen.parse_text("y", ctx).empty());
+		REQUIRE(large_frozen.parse_text("", ctx).empty());
+	}
+
+	SECTION("any match agrees with the full match") {
+		for (const auto& round : random_rounds(7)) {
+			ac::trie t;
+			for (const auto& p : round.patterns) {
+				t.insert(p);
+			}
+			auto f = t.freeze();
+			ac::frozen_trie::match_context ctx;
+			for (const auto& topic : round.topics) {
+				INFO(topic);
+				bool expected = !f.parse_text(topic).empty();
+				REQUIRE(f.matches_any(topic, ctx) == expected);
+				REQUIRE(t.matches_any(topic) == expected);
+			}
+		}
+	}
+	SECTION("any match through each kind of keyword") {
+		ac::trie t;
+		t.insert("a.b");
+		t.insert("c.#");
+		t.insert("+.d");
+		auto f = t.freeze();
+		ac::frozen_trie::match_context ctx;
+		REQUIRE(f.matches_any("a.b", ctx));
+		REQUIRE(f.matches_any("c.x.y", ctx));
+		REQUIRE(f.matches_any("x.d", ctx));
+		REQUIRE_FALSE(f.matches_any("a.bc", ctx));
+		REQUIRE_FALSE(f.matches_any("c", ctx));
+		REQUIRE_FALSE(f.matches_any("x.y.d", ctx));
+		REQUIRE_FALSE(f.matches_any("", ctx));
+	}
+
+	SECTION("active states are deduplicated") {
+		// every '#' can absorb any number of segments, so without
+		// deduplication the paths through these patterns multiply
+		ac::trie t;
+		for (int i = 0; i < 100; ++i) {
+			t.insert("#.#.#.#.s" + std::to_string(i) + "e");
+		}
+		auto f = t.freeze();
+		std::string topic;
+		for (int i = 0; i < 16; ++i) {
+			topic += "ab.";
+		}
+		topic += "s7e";
+		ac::frozen_trie::match_context s;
+		auto matches = f.parse_text(topic, s);
+		REQUIRE(matches.size() == 1);
+		REQUIRE(matches.begin()->first.get_keyword() == "#.#.#.#.s7e");
+		REQUIRE(s.peak_active() <= f.num_states());
+		REQUIRE(spans(t.parse_text(topic)) == spans(matches));
+	}
+	SECTION("trailing multi level wildcards leave the active set") {
+		ac::trie t;
+		t.insert("a.#");
+		t.insert("a.a.#");
+		t.insert("a.a.a.#");
+		t.insert("abc.#");
+		auto f = t.freeze();
+		std::string topic;
+		for (int i = 0; i < 20; ++i) {
+			topic += "a.";
+		}
+		ac::frozen_trie::match_context s;
+		REQUIRE(keywords(t.parse_text(topic)) == keywords(f.parse_text(topic, s)));
+		REQUIRE(3 == f.parse_text(topic, s).size());
+		REQUIRE(1 == s.peak_active());
+		REQUIRE(1 == f.parse_text("abc.d.e").size());
+		REQUIRE(f.matches_any("abc.x", s));
+		REQUIRE_FALSE(f.matches_any("abc.", s));
+	}
+	SECTION("unbranched runs are path compressed") {
+		ac::trie t;
+		t.insert("hi.mom");
+		t.insert("hi.+.you");
+		auto f = t.freeze();
+		// root, 'h' + "i.", '+', '.' + "you"; "hi.mom" is a literal
+		REQUIRE(4 == f.num_states());
+		REQUIRE(1 == f.num_literals());
+		REQUIRE(1 == f.parse_text("hi.mom").size());
+		REQUIRE(1 == f.parse_text("hi.there.you").size());
+		REQUIRE(f.parse_text("hi.mo").empty());
+		REQUIRE(f.parse_text("hi.mob").empty());
+		REQUIRE(f.parse_text("hi.there.yo").empty());
+	}
+	SECTION("wildcards match whole segments") {
+		ac::trie t;
+		for (const auto& p : patterns) {
+			t.insert(p);
+		}
+		auto f = t.freeze();
+		auto emits = f.parse_text("im.not.james.bond");
+		REQUIRE(2 == emits.size());
+		REQUIRE(f.parse_text("nothing.here").empty());
+	}
+	SECTION("transition containers freeze to the same automaton") {
+		ac::trie t;
+		ac::basic_trie<char, ac::sorted_vector_transitions> vector_trie;
+		ac::basic_trie<char, ac::dense_transitions> dense_trie;
+		ac::basic_trie<char, ac::hash_transitions> hash_trie;
+		ac::basic_trie<char, ac::adaptive_transitions> adaptive_trie;
+		ac::basic_trie<char, ac::hybrid_transitions> hybrid_trie;
+		for (const auto& p : patterns) {
+			t.insert(p);
+			vector_trie.insert(p);
+			dense_trie.insert(p);
+			hash_trie.insert(p);
+			adaptive_trie.insert(p);
+			hybrid_trie.insert(p);
+		}
+		auto f = t.freeze();
+		auto vector_frozen = vector_trie.freeze();
+		auto dense_frozen = dense_trie.freeze();
+		auto hash_frozen = hash_trie.freeze();
+		auto adaptive_frozen = adaptive_trie.freeze();
+		auto hybrid_frozen = hybrid_trie.freeze();
+		REQUIRE(f.num_states() == hash_frozen.num_states());
+		for (const auto& topic : topics) {
+			INFO(topic);
+			auto expected = keywords(f.parse_text(topic));
+			REQUIRE(expected == keywords(vector_trie.parse_text(topic)));
+			REQUIRE(expected == keywords(dense_trie.parse_text(topic)));
+			REQUIRE(expected == keywords(hash_trie.parse_text(topic)));
+			REQUIRE(expected == keywords(vector_frozen.parse_text(topic)));
+			REQUIRE(expected == keywords(dense_frozen.parse_text(topic)));
+			REQUIRE(expected == keywords(hash_frozen.parse_text(topic)));
+			REQUIRE(expected == keywords(adaptive_trie.parse_text(topic)));
+			REQUIRE(expected == keywords(adaptive_frozen.parse_text(topic)));
+			REQUIRE(expected == keywords(hybrid_trie.parse_text(topic)));
+			REQUIRE(expected == keywords(hybrid_frozen.parse_text(topic)));
+		}
+	}
+	SECTION("frozen copy is unaffected by later inserts") {
+		ac::trie t;
+		t.insert("hi.mom");
+		auto f = t.freeze();
+		t.insert("hi.there");
+		REQUIRE(f.parse_text("hi.there").empty());
+		REQUIRE(1 == t.parse_text("hi.there").size());
+	}
+	SECTION("single level wildcards span long segments") {
+		ac::trie t;
+		for (const auto& p : patterns) {
+			t.insert(p);
+		}
+		auto f = t.freeze();
+		std::string segment(100, 'y');
+		segment[10] = '+';
+		for (const auto& topic : { "hi." + segment, "hi." + segment + ".how.are.you?", "im." + segment + ".bond",
+				"im." + segment + ".bond." + segment, "hi." + segment + ".how" }) {
+			INFO(topic);
+			REQUIRE(keywords(t.parse_text(topic)) == keywords(f.parse_text(topic)));
+		}
+		REQUIRE(3 == f.parse_text("im." + segment + ".bond").size());
+	}
+	SECTION("two byte stride agrees with single steps") {
+		// literals bypass the automaton, so the second pass uses prefix keywords
+		for (bool prefixes : { false, true }) {
+			for (const auto& round : random_rounds(7, 10, 50, 200, !prefixes)) {
+				ac::trie t;
+				for (const auto& p : round.patterns) {
+					t.insert(prefixes ? p + ".#" : p);
+				}
+				auto f = t.freeze();
+				t.two_byte_stride();
+				auto strided = t.freeze();
+				REQUIRE(f.num_states() == strided.num_states());
+				REQUIRE(0 == f.num_pair_transitions());
+				REQUIRE(0 < strided.num_pair_transitions());
+				for (const auto& topic : round.topics) {
+					INFO(topic);
+					REQUIRE(keywords(f.parse_text(topic)) == keywords(strided.parse_text(topic)));
+					REQUIRE(spans(f.parse_text(topic)) == spans(strided.parse_text(topic)));
+				}
+			}
+		}
+	}
+	SECTION("two byte stride stops between the bytes of a pair") {
+		ac::trie t;
+		t.two_byte_stride();
+		t.insert("ab.+");
+		t.insert("ac.+");
+		t.insert("abc.+");
+		t.insert("b.+");
+		auto f = t.freeze();
+		REQUIRE(0 < f.num_pair_transitions());
+		REQUIRE(keywords(f.parse_text("abc.x")) == (std::vector<std::string> { "abc.+" }));
+		REQUIRE(keywords(f.parse_text("ab.x")) == (std::vector<std::string> { "ab.+" }));
+		REQUIRE(keywords(f.parse_text("b.x")) == (std::vector<std::string> { "b.+" }));
+		REQUIRE(f.parse_text("a").empty());
+		REQUIRE(f.parse_text("ab").empty());
+		REQUIRE(f.parse_text("abc").empty());
+		REQUIRE(f.parse_text("ad.x").empty());
+		REQUIRE(f.parse_text("abcd.x").empty());
+	}
+	SECTION("two byte stride keeps case insensitivity") {
+		ac::trie t;
+		t.case_insensitive().two_byte_stride();
+		t.insert("ab.#");
+		t.insert("ac.#");
+		t.insert("ba.#");
+		t.insert("bb.#");
+		auto f = t.freeze();
+		REQUIRE(4 == f.num_pair_transitions());
+		REQUIRE(1 == f.parse_text("AB.x").size());
+		REQUIRE(1 == f.parse_text("aC.Y").size());
+		REQUIRE(1 == f.parse_text("Ba.z").size());
+		REQUIRE(f.parse_text("ad.x").empty());
+		REQUIRE(f.parse_text("ab.").empty());
+	}
+	SECTION("literal keywords are found through the perfect hash") {
+		auto round = random_rounds(7, 1, 2000, 2000, false).front();
+		const auto& literals = round.patterns;
+		ac::trie t;
+		for (const auto& p : literals) {
+			t.insert(p);
+		}
+		t.insert("a.+");
+		auto f = t.freeze();
+		REQUIRE(f.num_literals() <= literals.size());
+		REQUIRE(f.num_literals() > 0);
+		ac::frozen_trie::match_context ctx;
+		for (const auto& topic : literals) {
+			INFO(topic);
+			REQUIRE(keywords(t.parse_text(topic)) == keywords(f.parse_text(topic, ctx)));
+			REQUIRE(spans(t.parse_text(topic)) == spans(f.parse_text(topic, ctx)));
+			REQUIRE(f.matches_any(topic, ctx));
+		}
+		for (const auto& miss : round.topics) {
+			auto topic = miss + "c";
+			INFO(topic);
+			REQUIRE(keywords(t.parse_text(topic)) == keywords(f.parse_text(topic, ctx)));
+		}
+		REQUIRE(f.parse_text("").empty());
+	}
+	SECTION("literal keywords are reported alongside wildcards") {
+		ac::trie t;
+		t.insert("a.b");
+		t.insert("a.+");
+		t.insert("a.#");
+		t.insert("b");
+		auto f = t.freeze();
+		REQUIRE(2 == f.num_literals());
+		ac::frozen_trie::match_context ctx;
+		REQUIRE((std::vector<unsigned> { 0, 1, 2 }) == f.match_ids("a.b", ctx));
+		REQUIRE((std::vector<unsigned> { 1, 2 }) == f.match_ids("a.c", ctx));
+		REQUIRE((std::vector<unsigned> { 3 }) == f.match_ids("b", ctx));
+		REQUIRE(f.match_ids("a", ctx).empty());
+		REQUIRE(f.match_ids("a.", ctx).empty());
+		REQUIRE(f.match_ids("c", ctx).empty());
+	}
+	SECTION("equal literal keywords share a slot") {
+		ac::trie t;
+		t.case_insensitive();
+		t.insert("hi.mom");
+		t.insert("hi.there");
+		t.insert("hi.mom");
+		auto f = t.freeze();
+		REQUIRE(2 == f.num_literals());
+		ac::frozen_trie::match_context ctx;
+		REQUIRE((std::vector<unsigned> { 0, 2 }) == f.match_ids("HI.Mom", ctx));
+		REQUIRE((std::vector<unsigned> { 1 }) == f.match_ids("hi.there", ctx));
+		REQUIRE(f.match_ids("hi.mo", ctx).empty());
+		REQUIRE(f.match_ids("hi.moms", ctx).empty());
+	}
+	SECTION("unanchored tries are not frozen") {
+		ac::trie t;
+		t.unanchored();
+		t.insert("hi.+");
+		REQUIRE_THROWS_AS(t.freeze(), std::logic_error);
+	}
+	SECTION("case insensitive setting is carried over") {
+		ac::trie t;
+		t.case_insensitive();
+		t.insert("hi.mom");
+		auto f = t.freeze();
+		REQUIRE(1 == f.parse_text("HI.Mom").size());
+	}
+}
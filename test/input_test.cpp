@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 Christopher Gilbert.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#define CATCH_CONFIG_MAIN
+#include "../test/catch.hpp"
+
+#include "aho_corasick/aho_corasick.hpp"
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ac = aho_corasick;
+
+namespace {
+	const std::vector<std::string> patterns = {
+		"hi.#",
+		"hi.there",
+		"im.+.bond",
+	};
+
+	// topics packed back to back, the way they sit in a receive buffer
+	const std::string buffer = "hi.thereim.james.bondnothing.here";
+
+	std::vector<std::pair<size_t, size_t>> spans(const ac::trie::emit_collection& emits) {
+		std::vector<std::pair<size_t, size_t>> result;
+		for (const auto& e : emits) {
+			result.push_back(std::make_pair(e.first.get_start(), e.first.get_end()));
+		}
+		return result;
+	}
+}
+
+TEST_CASE("input views", "[input]") {
+	ac::trie t;
+	t.insert(patterns.begin(), patterns.end());
+	auto f = t.freeze();
+
+	SECTION("keyword ranges insert every keyword") {
+		REQUIRE(f.num_keywords() == 3);
+		REQUIRE(f.get_keyword(2) == "im.+.bond");
+	}
+
+	SECTION("pointer and length select a slice of a buffer") {
+		const char* topic = buffer.data() + 8;
+		auto expected = spans(t.parse_text(std::string("im.james.bond")));
+		REQUIRE(expected.size() == 1);
+		REQUIRE(spans(t.parse_text(topic, 13)) == expected);
+		REQUIRE(spans(f.parse_text(topic, 13)) == expected);
+		REQUIRE(t.parse_text(buffer.data(), 8).size() == 2);
+		REQUIRE(t.parse_text(buffer.data(), 7).size() == 1);
+	}
+
+	SECTION("iterator ranges need not be contiguous") {
+		std::list<char> topic(buffer.begin() + 8, buffer.begin() + 21);
+		auto expected = spans(t.parse_text(std::string("im.james.bond")));
+		REQUIRE(spans(t.parse_text(topic.begin(), topic.end())) == expected);
+		REQUIRE(spans(t.parse_text(buffer.begin() + 8, buffer.begin() + 21)) == expected);
+
+		ac::trie::match_context ctx;
+		REQUIRE(t.match(topic.begin(), topic.end(), ctx).size() == 1);
+		REQUIRE(ctx.matches()[0].index == 2);
+
+		// "hi.there" is a literal keyword, looked up without copying the text
+		std::list<char> literal(buffer.begin(), buffer.begin() + 8);
+		REQUIRE(t.match_ids(literal.begin(), literal.end(), ctx) == (std::vector<unsigned> { 0, 1 }));
+	}
+
+	SECTION("keywords can be inserted from a slice") {
+		ac::trie u;
+		u.insert(buffer.data(), 8);
+		auto matches = u.parse_text(std::string("hi.there"));
+		REQUIRE(matches.size() == 1);
+		REQUIRE(matches.begin()->first.get_keyword() == "hi.there");
+	}
+
+	SECTION("tokenise a slice") {
+		auto tokens = t.tokenise(buffer.data(), 8);
+		REQUIRE(tokens.size() == 1);
+		REQUIRE(tokens[0].is_match());
+		REQUIRE(tokens[0].get_fragment() == "hi.there");
+
+		tokens = t.tokenise(buffer.data() + 21, 12);
+		REQUIRE(tokens.size() == 1);
+		REQUIRE(!tokens[0].is_match());
+		REQUIRE(tokens[0].get_fragment() == "nothing.here");
+	}
+
+#if __cplusplus >= 201703L
+	SECTION("string views") {
+		std::string_view view(buffer);
+		auto expected = spans(t.parse_text(std::string("im.james.bond")));
+		REQUIRE(spans(t.parse_text(view.substr(8, 13))) == expected);
+		REQUIRE(spans(f.parse_text(view.substr(8, 13))) == expected);
+		REQUIRE(t.parse_text("hi.there").size() == 2);
+
+		ac::frozen_trie::match_context ctx;
+		REQUIRE(f.match(view.substr(0, 8), ctx).size() == 2);
+	}
+#endif
+}
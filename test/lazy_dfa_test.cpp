@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2018 Christopher Gilbert.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#define CATCH_CONFIG_MAIN
+#include "../test/catch.hpp"
+#include "../test/random_topic.hpp"
+
+#include "aho_corasick/aho_corasick.hpp"
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ac = aho_corasick;
+
+namespace {
+	std::vector<std::string> keywords(const ac::trie::emit_collection& emits) {
+		std::vector<std::string> result;
+		for (const auto& e : emits) {
+			result.push_back(e.first.get_keyword());
+		}
+		return result;
+	}
+}
+
+TEST_CASE("lazy dfa works as required", "[lazy_dfa]") {
+	SECTION("matches like the frozen trie") {
+		ac::trie t;
+		t.insert("hi.#");
+		t.insert("hi.there");
+		t.insert("hi.+.how.are.you?");
+		t.insert("im.#.bond");
+		auto f = t.freeze();
+		ac::lazy_dfa dfa(f);
+
+		REQUIRE(2 == dfa.parse_text("hi.there").size());
+		REQUIRE(2 == dfa.parse_text("hi.alex.how.are.you?").size());
+		REQUIRE(1 == dfa.parse_text("im.not.james.bond").size());
+		REQUIRE(dfa.parse_text("im.patrick").empty());
+		REQUIRE(dfa.parse_text("").empty());
+	}
+	SECTION("keywords extended by another keyword still match") {
+		ac::trie t;
+		t.insert("a.b");
+		t.insert("a.bc");
+		t.insert("+.d");
+		t.insert("+.de");
+		t.insert("e.#.f");
+		t.insert("e.#.fg");
+		auto f = t.freeze();
+		ac::lazy_dfa dfa(f);
+
+		REQUIRE(keywords(dfa.parse_text("a.b")) == (std::vector<std::string> { "a.b" }));
+		REQUIRE(keywords(dfa.parse_text("a.d")) == (std::vector<std::string> { "+.d" }));
+		REQUIRE(keywords(dfa.parse_text("e.x.f")) == (std::vector<std::string> { "e.#.f" }));
+		REQUIRE(keywords(dfa.parse_text("e.x.fg")) == (std::vector<std::string> { "e.#.fg" }));
+	}
+	SECTION("wide characters beyond the direct table") {
+		ac::wtrie t;
+		t.insert(L"\u00e9t\u00e9.#");
+		t.insert(L"\u65e5\u672c.+");
+		auto f = t.freeze();
+		ac::wlazy_dfa dfa(f);
+
+		REQUIRE(1 == dfa.parse_text(L"\u00e9t\u00e9.chaud").size());
+		REQUIRE(1 == dfa.parse_text(L"\u65e5\u672c.tokyo").size());
+		REQUIRE(1 == dfa.parse_text(L"\u65e5\u672c.tokyo").size());
+		REQUIRE(dfa.parse_text(L"\u65e5\u672c").empty());
+	}
+	SECTION("repeated topics reuse cached states") {
+		ac::trie t;
+		t.insert("hi.#");
+		t.insert("hi.+.you");
+		auto f = t.freeze();
+		ac::lazy_dfa dfa(f);
+
+		dfa.parse_text("hi.how.are.you");
+		auto states = dfa.num_states();
+		dfa.parse_text("hi.how.are.you");
+		REQUIRE(states == dfa.num_states());
+		REQUIRE(0 == dfa.num_flushes());
+	}
+	SECTION("bytes outside every pattern agree with the frozen trie") {
+		srand(17);
+		for (int round = 0; round < 20; ++round) {
+			ac::trie t;
+			if (round % 2) {
+				t.case_insensitive();
+			}
+			for (int i = 0; i < 20; ++i) {
+				t.insert(random_topic(true));
+			}
+			auto f = t.freeze();
+			ac::lazy_dfa dfa(f);
+			for (int i = 0; i < 200; ++i) {
+				std::string topic;
+				for (int j = 0, len = 1 + rand() % 12; j < len; ++j) {
+					topic.append(1, "abcABxyz.+#\xff"[rand() % 12]);
+				}
+				INFO(topic);
+				REQUIRE(keywords(f.parse_text(topic)) == keywords(dfa.parse_text(topic)));
+			}
+		}
+	}
+	SECTION("random patterns agree with the frozen trie") {
+		for (const auto& round : random_rounds(13)) {
+			ac::trie t;
+			for (const auto& p : round.patterns) {
+				t.insert(p);
+			}
+			auto f = t.freeze();
+			ac::lazy_dfa dfa(f);
+			// small enough to flush repeatedly
+			ac::lazy_dfa tiny(f, 8 * 1024);
+			for (const auto& topic : round.topics) {
+				INFO(topic);
+				auto expected = keywords(f.parse_text(topic));
+				REQUIRE(expected == keywords(dfa.parse_text(topic)));
+				REQUIRE(expected == keywords(tiny.parse_text(topic)));
+				REQUIRE(tiny.memory_usage() <= 8 * 1024);
+			}
+			REQUIRE(tiny.num_flushes() > 0);
+		}
+	}
+	SECTION("a budget too small for any state still matches") {
+		ac::trie t;
+		t.insert("hi.#");
+		t.insert("hi.+.you");
+		t.insert("hi.there");
+		auto f = t.freeze();
+		ac::lazy_dfa dfa(f, 1);
+		for (int i = 0; i < 3; ++i) {
+			REQUIRE(keywords(dfa.parse_text("hi.how.are.you")) == keywords(f.parse_text("hi.how.are.you")));
+			REQUIRE(keywords(dfa.parse_text("hi.there")) == keywords(f.parse_text("hi.there")));
+			REQUIRE(dfa.parse_text("ho.there").empty());
+		}
+		REQUIRE(dfa.num_flushes() > 0);
+	}
+	SECTION("batches agree with the frozen trie") {
+		for (auto& round : random_rounds(17, 10, 50, 64)) {
+			ac::trie t;
+			for (const auto& p : round.patterns) {
+				t.insert(p);
+			}
+			auto f = t.freeze();
+			auto& topics = round.topics;
+			for (size_t i = 0; i < topics.size(); i += 8) {
+				topics[i].clear();
+			}
+
+			ac::frozen_trie::match_context ctx;
+			for (size_t budget : { size_t(ac::lazy_dfa::default_memory_budget), size_t(8 * 1024) }) {
+				ac::lazy_dfa dfa(f, budget);
+				std::vector<std::vector<unsigned>> results;
+				for (size_t batch : { 1, 8, 32, 64 }) {
+					for (size_t first = 0; first < topics.size(); first += batch) {
+						dfa.match_batch(topics.data() + first, batch, results);
+						REQUIRE(results.size() == batch);
+						for (size_t i = 0; i < batch; ++i) {
+							INFO(topics[first + i]);
+							REQUIRE(results[i] == f.match_ids(topics[first + i], ctx));
+						}
+					}
+				}
+				REQUIRE((budget == ac::lazy_dfa::default_memory_budget || dfa.num_flushes() > 0));
+			}
+		}
+	}
+	SECTION("batch edge cases") {
+		ac::trie t;
+		t.insert("hi.#");
+		t.insert("hi.+.you");
+		auto f = t.freeze();
+		ac::lazy_dfa dfa(f);
+		std::vector<std::vector<unsigned>> results;
+
+		// a topic repeated across lanes, and lanes that end at different steps
+		std::vector<std::string> topics = { "hi.how.are.you", "hi.how.are.you", "hi", "", "hi.x.you", "ho.x" };
+		dfa.match_batch(topics.data(), topics.size(), results);
+		REQUIRE(topics.size() == results.size());
+		REQUIRE((std::vector<unsigned> { 0 }) == results[0]);
+		REQUIRE(results[0] == results[1]);
+		REQUIRE(results[2].empty());
+		REQUIRE(results[3].empty());
+		REQUIRE((std::vector<unsigned> { 0, 1 }) == results[4]);
+		REQUIRE(results[5].empty());
+
+		// an empty batch leaves no stale results behind
+		dfa.match_batch(topics.data(), 0, results);
+		REQUIRE(results.empty());
+	}
+}
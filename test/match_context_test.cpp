@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2018 Christopher Gilbert.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#define CATCH_CONFIG_MAIN
+#include "../test/catch.hpp"
+
+#include "aho_corasick/aho_corasick.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ac = aho_corasick;
+
+namespace {
+	size_t num_allocations = 0;
+}
+
+void* operator new(size_t size) {
+	++num_allocations;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	++num_allocations;
+	return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+namespace {
+	const std::vector<std::string> topics = {
+		"hi.mom",
+		"hi.there",
+		"hi.alex.how.are.you?",
+		"hi.james.how.are.you?",
+		"im.patrick.bond",
+		"im.james.bond",
+		"im.not.james.bond",
+		"nothing.here",
+	};
+
+	const std::vector<std::string> patterns = {
+		"hi.#",
+		"hi.+",
+		"hi.there",
+		"hi.mom",
+		"hi.+.how.are.you?",
+		"im.james.bond",
+		"im.+.bond",
+		"im.#.bond",
+		"im.#",
+	};
+
+	template<typename Trie>
+	void insert_patterns(Trie& t) {
+		for (const auto& p : patterns) {
+			t.insert(p);
+		}
+	}
+
+	std::set<std::pair<size_t, size_t>> spans(const ac::trie::emit_collection& emits) {
+		std::set<std::pair<size_t, size_t>> result;
+		for (const auto& e : emits) {
+			result.insert(std::make_pair(e.first.get_start(), e.first.get_end()));
+		}
+		return result;
+	}
+
+	std::set<std::pair<size_t, size_t>> spans(const std::vector<ac::match_result>& matches) {
+		std::set<std::pair<size_t, size_t>> result;
+		for (const auto& m : matches) {
+			result.insert(std::make_pair(m.start, m.end));
+		}
+		return result;
+	}
+
+	std::set<std::string> keywords(const std::vector<ac::match_result>& matches) {
+		std::set<std::string> result;
+		for (const auto& m : matches) {
+			result.insert(patterns[m.index]);
+		}
+		return result;
+	}
+
+	template<typename Trie, typename Context>
+	size_t allocations_matching(const Trie& t, Context& ctx) {
+		size_t before = num_allocations;
+		for (const auto& topic : topics) {
+			t.match(topic.data(), topic.size(), ctx);
+		}
+		return num_allocations - before;
+	}
+}
+
+TEST_CASE("match context", "[match-context]") {
+	ac::trie t;
+	insert_patterns(t);
+	auto f = t.freeze();
+
+	SECTION("matches agree with parse_text") {
+		ac::trie::match_context trie_ctx;
+		ac::frozen_trie::match_context frozen_ctx;
+		for (const auto& topic : topics) {
+			INFO(topic);
+			auto expected = spans(t.parse_text(topic));
+			REQUIRE(spans(t.match(topic, trie_ctx)) == expected);
+			REQUIRE(spans(f.match(topic, frozen_ctx)) == expected);
+			REQUIRE(keywords(trie_ctx.matches()) == keywords(frozen_ctx.matches()));
+		}
+	}
+
+	SECTION("equal length patterns are all reported") {
+		ac::frozen_trie::match_context ctx;
+		auto& matches = f.match("hi.mom", ctx);
+		REQUIRE(keywords(matches) == std::set<std::string>({ "hi.#", "hi.+", "hi.mom" }));
+		for (const auto& m : matches) {
+			REQUIRE(m.end == 5);
+		}
+	}
+
+	SECTION("match ids name every matching keyword once") {
+		ac::trie::match_context trie_ctx;
+		ac::frozen_trie::match_context frozen_ctx;
+		std::vector<unsigned> expected = { 0, 1, 3 };
+		REQUIRE(t.match_ids("hi.mom", trie_ctx) == expected);
+		REQUIRE(f.match_ids("hi.mom", frozen_ctx) == expected);
+		REQUIRE(frozen_ctx.ids() == expected);
+		REQUIRE(t.get_keyword(3) == "hi.mom");
+		REQUIRE(t.num_keywords() == patterns.size());
+		for (const auto& topic : topics) {
+			INFO(topic);
+			std::vector<unsigned> ids;
+			for (const auto& m : f.match(topic, frozen_ctx)) {
+				ids.push_back(m.index);
+			}
+			std::sort(ids.begin(), ids.end());
+			REQUIRE(f.match_ids(topic, frozen_ctx) == ids);
+			REQUIRE(t.match_ids(topic, trie_ctx) == ids);
+		}
+	}
+
+	SECTION("parse_text keeps equal length keywords apart") {
+		auto emits = t.parse_text(std::string("hi.mom"));
+		std::set<unsigned> ids;
+		for (const auto& e : emits) {
+			ids.insert(e.first.get_index());
+		}
+		REQUIRE(ids == std::set<unsigned>({ 0, 1, 3 }));
+	}
+
+	SECTION("any and first match") {
+		ac::trie::match_context trie_ctx;
+		ac::frozen_trie::match_context frozen_ctx;
+		for (const auto& topic : topics) {
+			INFO(topic);
+			bool expected = !f.match_ids(topic, frozen_ctx).empty();
+			REQUIRE(t.matches_any(topic) == expected);
+			REQUIRE(t.matches_any(topic, trie_ctx) == expected);
+			REQUIRE(f.matches_any(topic) == expected);
+			REQUIRE(f.matches_any(topic, frozen_ctx) == expected);
+
+			ac::match_result trie_first = { 0, 0, 0 };
+			ac::match_result frozen_first = { 0, 0, 0 };
+			REQUIRE(t.first_match(topic, trie_first) == expected);
+			REQUIRE(f.first_match(topic, frozen_first, frozen_ctx) == expected);
+			if (expected) {
+				auto& ids = f.match_ids(topic, frozen_ctx);
+				REQUIRE(std::count(ids.begin(), ids.end(), trie_first.index) == 1);
+				REQUIRE(std::count(ids.begin(), ids.end(), frozen_first.index) == 1);
+				REQUIRE(frozen_first.end == topic.size() - 1);
+			}
+		}
+	}
+
+	SECTION("a trailing '#' accepts before the end of the topic") {
+		ac::frozen_trie::match_context ctx;
+		ac::match_result first = { 0, 0, 0 };
+		REQUIRE(f.first_match("im.patrick.bond.is.not.here", first, ctx));
+		REQUIRE(patterns[first.index] == "im.#");
+		REQUIRE(first.end == 26);
+		REQUIRE(t.first_match("im.patrick.bond.is.not.here", first));
+		REQUIRE(patterns[first.index] == "im.#");
+		REQUIRE(!t.matches_any("hi"));
+		REQUIRE(!f.matches_any(""));
+	}
+
+	SECTION("handlers see every match once") {
+		ac::trie::match_context trie_ctx;
+		ac::frozen_trie::match_context frozen_ctx;
+		for (const auto& topic : topics) {
+			INFO(topic);
+			std::vector<unsigned> trie_ids;
+			std::vector<unsigned> frozen_ids;
+			REQUIRE(!t.parse_text(topic, [&](unsigned index, size_t, size_t end) {
+				REQUIRE(end == topic.size() - 1);
+				trie_ids.push_back(index);
+			}));
+			REQUIRE(!f.parse_text(topic, [&](unsigned index, size_t, size_t) {
+				frozen_ids.push_back(index);
+				return false;
+			}, frozen_ctx));
+			std::sort(trie_ids.begin(), trie_ids.end());
+			std::sort(frozen_ids.begin(), frozen_ids.end());
+			REQUIRE(trie_ids == f.match_ids(topic, frozen_ctx));
+			REQUIRE(frozen_ids == t.match_ids(topic, trie_ctx));
+		}
+	}
+
+	SECTION("a handler can stop the scan") {
+		size_t calls = 0;
+		auto stop = [&](unsigned, size_t, size_t) { ++calls; return true; };
+		REQUIRE(f.parse_text(std::string("hi.mom"), stop));
+		REQUIRE(t.parse_text(std::string("hi.mom"), stop));
+		REQUIRE(calls == 2);
+		REQUIRE(!f.parse_text(std::string("nothing.here"), stop));
+		REQUIRE(calls == 2);
+	}
+
+	SECTION("results are ordered and replaced by the next match") {
+		ac::trie::match_context ctx;
+		auto& matches = t.match("im.james.bond", ctx);
+		REQUIRE(matches.size() == 4);
+		for (size_t i = 1; i < matches.size(); ++i) {
+			REQUIRE(matches[i - 1].index < matches[i].index);
+		}
+		t.match("nothing.here", ctx);
+		REQUIRE(ctx.matches().empty());
+	}
+
+	SECTION("a warm context does not allocate") {
+		ac::trie::match_context trie_ctx;
+		ac::frozen_trie::match_context frozen_ctx;
+		allocations_matching(t, trie_ctx);
+		allocations_matching(f, frozen_ctx);
+		REQUIRE(allocations_matching(t, trie_ctx) == 0);
+		REQUIRE(allocations_matching(f, frozen_ctx) == 0);
+
+		for (const auto& topic : topics) {
+			f.match_ids(topic, frozen_ctx);
+		}
+		size_t before = num_allocations;
+		size_t count = 0;
+		for (const auto& topic : topics) {
+			f.match_ids(topic, frozen_ctx);
+			f.parse_text(topic.data(), topic.size(), [&](unsigned, size_t, size_t) { ++count; }, frozen_ctx);
+			t.parse_text(topic.data(), topic.size(), [&](unsigned, size_t, size_t) { ++count; }, trie_ctx);
+		}
+		REQUIRE(num_allocations == before);
+		REQUIRE(count > 0);
+	}
+}
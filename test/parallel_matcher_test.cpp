@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2018 Christopher Gilbert.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#define CATCH_CONFIG_MAIN
+#include "../test/catch.hpp"
+#include "../test/random_topic.hpp"
+
+#include "aho_corasick/aho_corasick.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ac = aho_corasick;
+
+namespace {
+	template<typename Trie>
+	std::vector<std::vector<unsigned>> sequential(const Trie& t, const std::vector<std::string>& texts) {
+		typename Trie::match_context ctx;
+		std::vector<std::vector<unsigned>> result;
+		for (const auto& text : texts) {
+			const auto& ids = t.match_ids(text.data(), text.size(), ctx);
+			result.push_back(std::vector<unsigned>(ids.begin(), ids.end()));
+		}
+		return result;
+	}
+}
+
+TEST_CASE("parallel matcher works as required", "[parallel_matcher]") {
+	srand(7);
+	ac::trie t;
+	for (int i = 0; i < 200; ++i) {
+		t.insert(random_topic(true));
+	}
+	auto f = t.freeze();
+
+	std::vector<std::string> texts;
+	for (int i = 0; i < 2000; ++i) {
+		texts.push_back(random_topic(false));
+	}
+	auto expected = sequential(f, texts);
+
+	SECTION("batches agree with sequential matching") {
+		for (unsigned threads : { 1u, 2u, 4u, 7u }) {
+			ac::parallel_matcher<ac::frozen_trie> matcher(f, threads);
+			REQUIRE(threads == matcher.num_threads());
+			for (size_t count : { size_t(0), size_t(1), size_t(15), size_t(333), texts.size() }) {
+				std::vector<std::vector<unsigned>> results;
+				matcher.match_batch(texts.data(), count, results);
+				REQUIRE(count == results.size());
+				for (size_t i = 0; i < count; ++i) {
+					REQUIRE(expected[i] == results[i]);
+				}
+			}
+		}
+	}
+	SECTION("results are replaced by the next batch") {
+		ac::parallel_matcher<ac::frozen_trie> matcher(f, 3);
+		std::vector<std::vector<unsigned>> results;
+		matcher.match_batch(texts.data(), texts.size(), results);
+		matcher.match_batch(texts.data() + 100, 50, results);
+		REQUIRE(50 == results.size());
+		for (size_t i = 0; i < 50; ++i) {
+			REQUIRE(expected[100 + i] == results[i]);
+		}
+	}
+	SECTION("edge cases of a batch") {
+		ac::parallel_matcher<ac::frozen_trie> matcher(f);
+		REQUIRE(std::max(1u, std::thread::hardware_concurrency()) == matcher.num_threads());
+
+		// empty texts, and fewer texts than workers
+		std::vector<std::string> few = { "", texts[0], "" };
+		std::vector<std::vector<unsigned>> results;
+		ac::parallel_matcher<ac::frozen_trie> wide(f, 8);
+		wide.match_batch(few.data(), few.size(), results);
+		REQUIRE(3 == results.size());
+		REQUIRE(results[0].empty());
+		REQUIRE(expected[0] == results[1]);
+		REQUIRE(results[2].empty());
+
+		// the same text throughout a batch
+		std::vector<std::string> same(500, texts[1]);
+		matcher.match_batch(same.data(), same.size(), results);
+		for (const auto& result : results) {
+			REQUIRE(expected[1] == result);
+		}
+	}
+	SECTION("works on the mutable trie") {
+		ac::parallel_matcher<ac::trie> matcher(t, 4);
+		std::vector<std::vector<unsigned>> results;
+		matcher.match_batch(texts.data(), texts.size(), results);
+		REQUIRE(sequential(t, texts) == results);
+		REQUIRE(expected == results);
+	}
+	SECTION("a fresh trie can be matched from several threads at once") {
+		for (int mode = 0; mode < 3; ++mode) {
+			ac::trie fresh;
+			if (mode == 1) {
+				fresh.unanchored();
+			} else if (mode == 2) {
+				fresh.unanchored().full_dfa();
+			}
+			for (int i = 0; i < 200; ++i) {
+				fresh.insert(random_topic(mode == 0));
+			}
+			// no match has run yet, so the threads race to build the tables
+			std::vector<std::vector<std::vector<unsigned>>> results(4);
+			std::vector<std::thread> threads;
+			for (auto& result : results) {
+				threads.emplace_back([&] { result = sequential(fresh, texts); });
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			for (const auto& result : results) {
+				REQUIRE(sequential(fresh, texts) == result);
+			}
+		}
+	}
+}
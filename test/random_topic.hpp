@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018 Christopher Gilbert.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef RANDOM_TOPIC_HPP
+#define RANDOM_TOPIC_HPP
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// A topic of one to five segments over a three letter alphabet, each at
+// most max_segment_length characters long, so that patterns share prefixes
+// and wildcards overlap as much as possible. With wildcards set, a segment
+// may also be '+' or '#', which makes it a pattern. Draws from rand(), so
+// srand fixes the sequence.
+inline std::string random_topic(bool wildcards, int max_segment_length = 3) {
+	static const char alphabet[] = "abc";
+	std::string result;
+	int segments = 1 + rand() % 5;
+	for (int i = 0; i < segments; ++i) {
+		if (i > 0) {
+			result.append(".");
+		}
+		int kind = rand() % 6;
+		if (wildcards && kind == 0) {
+			result.append("+");
+		} else if (wildcards && kind == 1) {
+			result.append("#");
+		} else {
+			int len = 1 + rand() % max_segment_length;
+			for (int j = 0; j < len; ++j) {
+				result.append(1, alphabet[rand() % 3]);
+			}
+		}
+	}
+	return result;
+}
+
+// One round of a randomised comparison: patterns to insert into a trie and
+// topics to match against it.
+struct random_round {
+	std::vector<std::string> patterns;
+	std::vector<std::string> topics;
+};
+
+// Seeds rand() and draws num_rounds rounds of random patterns and topics.
+// Patterns carry wildcards unless wildcards is false; topics never do.
+inline std::vector<random_round> random_rounds(unsigned seed, int num_rounds = 20, int num_patterns = 50,
+		int num_topics = 200, bool wildcards = true) {
+	srand(seed);
+	std::vector<random_round> result(num_rounds);
+	for (auto& round : result) {
+		for (int i = 0; i < num_patterns; ++i) {
+			round.patterns.push_back(random_topic(wildcards));
+		}
+		for (int i = 0; i < num_topics; ++i) {
+			round.topics.push_back(random_topic(false));
+		}
+	}
+	return result;
+}
+
+#endif // RANDOM_TOPIC_HPP
@@ -24,9 +24,33 @@
 #include "../test/catch.hpp"
 
 #include "aho_corasick/aho_corasick.hpp"
+#include <algorithm>
+#include <string>
 
 namespace ac = aho_corasick;
 
+namespace {
+	template<typename State>
+	void check_branching(State& root) {
+		for (char c = 'z'; c >= 'a'; --c) {
+			root.add_state(c)->add_state('.');
+		}
+		REQUIRE(26 == root.get_states().size());
+		auto transitions = root.get_transitions();
+		std::sort(transitions.begin(), transitions.end());
+		REQUIRE('a' == transitions.front());
+		REQUIRE('z' == transitions.back());
+		for (char c = 'a'; c <= 'z'; ++c) {
+			auto next = root.next_state(c);
+			REQUIRE(next != nullptr);
+			REQUIRE(c == next->value());
+			REQUIRE(next == root.add_state(c));
+		}
+		REQUIRE(nullptr == root.next_state('A'));
+		REQUIRE(nullptr == root.next_state('.'));
+	}
+}
+
 TEST_CASE("state works as required", "[state]") {
 	SECTION("construct character sequence") {
 		auto root = new ac::state<char>();
@@ -42,4 +66,48 @@ TEST_CASE("state works as required", "[state]") {
 		REQUIRE(3 == cur_state->get_depth());
 		delete root;
 	}
-}
\ No newline at end of file
+	SECTION("transition containers agree") {
+		ac::state<char, ac::map_transitions> map_root;
+		check_branching(map_root);
+		ac::state<char, ac::sorted_vector_transitions> vector_root;
+		check_branching(vector_root);
+		ac::state<char, ac::dense_transitions> dense_root;
+		check_branching(dense_root);
+		ac::state<char, ac::hash_transitions> hash_root;
+		check_branching(hash_root);
+		ac::state<char, ac::adaptive_transitions> adaptive_root;
+		check_branching(adaptive_root);
+		ac::state<char, ac::hybrid_transitions> hybrid_root;
+		check_branching(hybrid_root);
+	}
+	SECTION("hybrid transitions switch to the sparse form below the dense levels") {
+		ac::state<char, ac::hybrid_transitions> root;
+		auto cur_state = &root;
+		for (int depth = 0; depth < 4; ++depth) {
+			cur_state->add_state('b');
+			cur_state->add_state('a');
+			check_branching(*cur_state->add_state('c'));
+			REQUIRE(3 == cur_state->get_states().size());
+			auto transitions = cur_state->get_transitions();
+			std::sort(transitions.begin(), transitions.end());
+			REQUIRE(std::string("abc") == std::string(transitions.begin(), transitions.end()));
+			cur_state = cur_state->next_state('a');
+			REQUIRE(cur_state != nullptr);
+		}
+	}
+	SECTION("adaptive transitions grow through every node kind") {
+		ac::state<char, ac::adaptive_transitions> root;
+		for (int i = 0; i < 256; ++i) {
+			root.add_state(static_cast<char>(i));
+			REQUIRE(static_cast<size_t>(i + 1) == root.get_states().size());
+			for (int j = 0; j <= i; ++j) {
+				auto next = root.next_state(static_cast<char>(j));
+				REQUIRE(next != nullptr);
+				REQUIRE(static_cast<char>(j) == next->value());
+			}
+			if (i < 255) {
+				REQUIRE(nullptr == root.next_state(static_cast<char>(i + 1)));
+			}
+		}
+	}
+}
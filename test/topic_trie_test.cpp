@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2018 Christopher Gilbert.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#define CATCH_CONFIG_MAIN
+#include "../test/catch.hpp"
+#include "../test/random_topic.hpp"
+
+#include "aho_corasick/aho_corasick.hpp"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace ac = aho_corasick;
+
+namespace {
+	std::vector<std::string> split(const std::string& s) {
+		std::vector<std::string> result;
+		size_t start = 0;
+		while (true) {
+			size_t end = s.find('.', start);
+			result.push_back(s.substr(start, end - start));
+			if (end == std::string::npos)
+				return result;
+			start = end + 1;
+		}
+	}
+
+	// straightforward recursive reference for '+' (one segment) and '#' (one
+	// or more segments)
+	bool reference_match(const std::vector<std::string>& pattern, size_t p, const std::vector<std::string>& topic, size_t t) {
+		if (p == pattern.size())
+			return t == topic.size();
+		if (t == topic.size())
+			return false;
+		if (pattern[p] == "#") {
+			for (size_t rest = t + 1; rest <= topic.size(); ++rest) {
+				if (reference_match(pattern, p + 1, topic, rest))
+					return true;
+			}
+			return false;
+		}
+		if (pattern[p] == "+" || pattern[p] == topic[t])
+			return reference_match(pattern, p + 1, topic, t + 1);
+		return false;
+	}
+
+	std::vector<std::string> keywords(const ac::topic_trie::emit_collection& emits) {
+		std::vector<std::string> result;
+		for (const auto& e : emits) {
+			result.push_back(e.get_keyword());
+		}
+		return result;
+	}
+}
+
+TEST_CASE("topic trie works as required", "[topic_trie]") {
+	SECTION("literal and wildcard patterns") {
+		ac::topic_trie t;
+		t.insert("hi.#");
+		t.insert("hi.+");
+		t.insert("hi.there");
+		t.insert("hi.mom");
+		t.insert("hi.+.how.are.you?");
+		t.insert("im.james.bond");
+		t.insert("im.+.bond");
+		t.insert("im.#.bond");
+		t.insert("im.#");
+
+		REQUIRE(keywords(t.parse_text("hi.mom")) == std::vector<std::string>({"hi.#", "hi.+", "hi.mom"}));
+		REQUIRE(keywords(t.parse_text("hi.james.how.are.you?")) == std::vector<std::string>({"hi.#", "hi.+.how.are.you?"}));
+		REQUIRE(keywords(t.parse_text("im.not.james.bond")) == std::vector<std::string>({"im.#.bond", "im.#"}));
+		REQUIRE(keywords(t.parse_text("im.james.bond")) == std::vector<std::string>({"im.james.bond", "im.+.bond", "im.#.bond", "im.#"}));
+		REQUIRE(t.parse_text("im").empty());
+		REQUIRE(t.parse_text("nothing.here").empty());
+		REQUIRE(t.parse_text("").empty());
+	}
+	SECTION("literal segments are interned once") {
+		ac::topic_trie t;
+		t.insert("a.b.c");
+		t.insert("b.a.c");
+		t.insert("a.+.c");
+		REQUIRE(3 == t.num_segments());
+		REQUIRE(3 == t.num_keywords());
+	}
+	SECTION("a pattern that prefixes another still matches") {
+		ac::topic_trie t;
+		t.insert("a.b");
+		t.insert("a.bc");
+		t.insert("a.b.c");
+		REQUIRE(keywords(t.parse_text("a.b")) == std::vector<std::string>({"a.b"}));
+		REQUIRE(keywords(t.parse_text("a.bc")) == std::vector<std::string>({"a.bc"}));
+	}
+	SECTION("leading and repeated wildcards") {
+		ac::topic_trie t;
+		t.insert("#");
+		t.insert("+");
+		t.insert("#.b");
+		t.insert("a.#.#");
+		REQUIRE(keywords(t.parse_text("a")) == std::vector<std::string>({"#", "+"}));
+		REQUIRE(keywords(t.parse_text("b")) == std::vector<std::string>({"#", "+"}));
+		REQUIRE(keywords(t.parse_text("a.b")) == std::vector<std::string>({"#", "#.b"}));
+		REQUIRE(keywords(t.parse_text("a.b.c")) == std::vector<std::string>({"#", "a.#.#"}));
+		REQUIRE(keywords(t.parse_text("x.y.b")) == std::vector<std::string>({"#", "#.b"}));
+	}
+	SECTION("wildcards match empty segments") {
+		ac::topic_trie t;
+		t.insert("a.+.b");
+		t.insert("a.#.b");
+		t.insert("a.+");
+		t.insert("+.a");
+		REQUIRE(keywords(t.parse_text("a..b")) == std::vector<std::string>({"a.+.b", "a.#.b"}));
+		REQUIRE(keywords(t.parse_text("a...b")) == std::vector<std::string>({"a.#.b"}));
+		REQUIRE(keywords(t.parse_text("a.")) == std::vector<std::string>({"a.+"}));
+		REQUIRE(keywords(t.parse_text(".a")) == std::vector<std::string>({"+.a"}));
+		REQUIRE(t.parse_text("a..").empty());
+	}
+	SECTION("custom separator") {
+		ac::wtopic_trie t(L'/');
+		t.insert(L"sensors/+/temp");
+		REQUIRE(1 == t.parse_text(L"sensors/kitchen/temp").size());
+		REQUIRE(t.parse_text(L"sensors.kitchen.temp").empty());
+	}
+	SECTION("random patterns agree with the reference") {
+		srand(11);
+		for (int round = 0; round < 20; ++round) {
+			ac::topic_trie t;
+			std::vector<std::string> patterns;
+			for (int i = 0; i < 40; ++i) {
+				patterns.push_back(random_topic(true, 2));
+				t.insert(patterns.back());
+			}
+			for (int i = 0; i < 200; ++i) {
+				auto topic = random_topic(false, 2);
+				std::vector<std::string> expected;
+				for (const auto& p : patterns) {
+					if (reference_match(split(p), 0, split(topic), 0))
+						expected.push_back(p);
+				}
+				INFO(topic);
+				REQUIRE(expected == keywords(t.parse_text(topic)));
+			}
+		}
+	}
+}
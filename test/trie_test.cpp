@@ -24,26 +24,31 @@
 #include "../test/catch.hpp"
 
 #include "aho_corasick/aho_corasick.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace ac = aho_corasick;
 
 TEST_CASE("trie works as required", "[trie]") {
-	const auto check_emit = [](const ac::emit<char>& next, size_t expect_start, size_t expect_end, std::string expect_keyword) -> void {
-		REQUIRE(expect_start == next.get_start());
-		REQUIRE(expect_end == next.get_end());
-		REQUIRE(expect_keyword == next.get_keyword());
+	const auto check_emit = [](const std::pair<const ac::emit<char>, bool>& next, size_t expect_start, size_t expect_end, std::string expect_keyword) -> void {
+		REQUIRE(expect_start == next.first.get_start());
+		REQUIRE(expect_end == next.first.get_end());
+		REQUIRE(expect_keyword == next.first.get_keyword());
 	};
-	const auto check_wemit = [](const ac::emit<wchar_t>& next, size_t expect_start, size_t expect_end, std::wstring expect_keyword) -> void {
-		REQUIRE(expect_start == next.get_start());
-		REQUIRE(expect_end == next.get_end());
-		REQUIRE(expect_keyword == next.get_keyword());
+	const auto check_wemit = [](const std::pair<const ac::emit<wchar_t>, bool>& next, size_t expect_start, size_t expect_end, std::wstring expect_keyword) -> void {
+		REQUIRE(expect_start == next.first.get_start());
+		REQUIRE(expect_end == next.first.get_end());
+		REQUIRE(expect_keyword == next.first.get_keyword());
 	};
 	const auto check_token = [](const ac::trie::token_type& next, std::string expect_fragment) -> void {
 		REQUIRE(expect_fragment == next.get_fragment());
 	};
 	SECTION("keyword and text are the same") {
 		ac::trie t;
+		t.unanchored();
 		t.insert("abc");
 		auto emits = t.parse_text("abc");
 		const auto it = emits.begin();
@@ -51,6 +56,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("text is longer than the keyword") {
 		ac::trie t;
+		t.unanchored();
 		t.insert("abc");
 
 		auto emits = t.parse_text(" abc");
@@ -60,6 +66,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("various keywords one match") {
 		ac::trie t;
+		t.unanchored();
 		t.insert("abc");
 		t.insert("bcd");
 		t.insert("cde");
@@ -71,6 +78,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("ushers test") {
 		ac::trie t;
+		t.unanchored();
 		t.insert("hers");
 		t.insert("his");
 		t.insert("she");
@@ -80,12 +88,13 @@ TEST_CASE("trie works as required", "[trie]") {
 		REQUIRE(3 == emits.size());
 
 		auto it = emits.begin();
-		check_emit(*it++, 2, 3, "he");
 		check_emit(*it++, 1, 3, "she");
 		check_emit(*it++, 2, 5, "hers");
+		check_emit(*it++, 2, 3, "he");
 	}
 	SECTION("misleading test") {
 		ac::trie t;
+		t.unanchored();
 		t.insert("hers");
 
 		auto emits = t.parse_text("h he her hers");
@@ -95,6 +104,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("recipes") {
 		ac::trie t;
+		t.unanchored();
 		t.insert("veal");
 		t.insert("cauliflower");
 		t.insert("broccoli");
@@ -111,6 +121,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("long and short overlapping match") {
 		ac::trie t;
+		t.unanchored();
 		t.insert("he");
 		t.insert("hehehehe");
 
@@ -119,15 +130,16 @@ TEST_CASE("trie works as required", "[trie]") {
 
 		auto it = emits.begin();
 		check_emit(*it++, 0, 1, "he");
+		check_emit(*it++, 0, 7, "hehehehe");
 		check_emit(*it++, 2, 3, "he");
+		check_emit(*it++, 2, 9, "hehehehe");
 		check_emit(*it++, 4, 5, "he");
 		check_emit(*it++, 6, 7, "he");
-		check_emit(*it++, 0, 7, "hehehehe");
 		check_emit(*it++, 8, 9, "he");
-		check_emit(*it++, 2, 9, "hehehehe");
 	}
 	SECTION("non overlapping") {
 		ac::trie t;
+		t.unanchored();
 		t.remove_overlaps();
 		t.insert("ab");
 		t.insert("cba");
@@ -142,6 +154,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("partial match") {
 		ac::trie t;
+		t.unanchored();
 		t.only_whole_words();
 		t.insert("sugar");
 
@@ -153,6 +166,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("tokenise tokens in sequence") {
 		ac::trie t;
+		t.unanchored();
 		t.insert("Alpha");
 		t.insert("Beta");
 		t.insert("Gamma");
@@ -162,6 +176,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("tokenise full sentence") {
 		ac::trie t;
+		t.unanchored();
 		t.only_whole_words();
 		t.insert("Alpha");
 		t.insert("Beta");
@@ -181,7 +196,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("wtrie case insensitive") {
 		ac::wtrie t;
-		t.case_insensitive().only_whole_words();
+		t.unanchored().case_insensitive().only_whole_words();
 		t.insert(L"turning");
 		t.insert(L"once");
 		t.insert(L"again");
@@ -196,6 +211,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("trie case insensitive") {
 		ac::trie t;
+		t.unanchored();
 		t.case_insensitive();
 		t.insert("turning");
 		t.insert("once");
@@ -211,6 +227,7 @@ TEST_CASE("trie works as required", "[trie]") {
 	}
 	SECTION("segault with incremental parsing: github issue #7") {
 		ac::trie t;
+		t.unanchored();
 
 		t.insert("hers");
 		t.insert("his");
@@ -224,4 +241,260 @@ TEST_CASE("trie works as required", "[trie]") {
 		result = t.parse_text("something");
 		CHECK(result.empty());
 	}
-}
\ No newline at end of file
+	SECTION("every suffix keyword is reported at a position") {
+		ac::trie t;
+		t.unanchored();
+		t.insert("hers");
+		t.insert("ers");
+		t.insert("rs");
+		t.insert("s");
+		t.insert("she");
+
+		ac::trie::match_context ctx;
+		const auto& matches = t.match("ushers", ctx);
+		REQUIRE(6 == matches.size());
+		REQUIRE(3 == matches[0].index); // s
+		REQUIRE(4 == matches[1].index); // she
+		REQUIRE(0 == matches[2].index); // hers
+		REQUIRE(1 == matches[3].index); // ers
+		REQUIRE(2 == matches[4].index); // rs
+		REQUIRE(3 == matches[5].index); // s
+		for (size_t i = 2; i < matches.size(); ++i) {
+			REQUIRE(5 == matches[i].end);
+		}
+
+		t.insert("shers");
+		REQUIRE(7 == t.match("ushers", ctx).size());
+	}
+	SECTION("wildcards are plain characters when unanchored") {
+		ac::trie t;
+		t.unanchored();
+		t.insert("hi.#");
+		t.insert("+");
+
+		auto emits = t.parse_text("say hi.# a+b");
+		REQUIRE(2 == emits.size());
+
+		auto it = emits.begin();
+		check_emit(*it++, 4, 7, "hi.#");
+		check_emit(*it++, 10, 10, "+");
+	}
+	SECTION("explicit build gives the same matches") {
+		ac::trie t;
+		t.unanchored();
+		t.insert("he");
+		t.insert("she");
+		t.insert("hers");
+		t.build();
+		REQUIRE(3 == t.parse_text("ushers").size());
+
+		t.insert("us");
+		t.build();
+		REQUIRE(4 == t.parse_text("ushers").size());
+	}
+	SECTION("anchored topic matching is the default") {
+		ac::trie t;
+		t.insert("hi.#");
+		t.insert("there");
+
+		auto emits = t.parse_text("hi.there");
+		REQUIRE(1 == emits.size());
+		REQUIRE(7 == emits.begin()->first.get_end());
+		REQUIRE("hi.#" == emits.begin()->first.get_keyword());
+	}
+	SECTION("single level wildcards span long segments") {
+		ac::trie t;
+		t.insert("hi.+");
+		t.insert("hi.+.bond");
+		t.insert("+.mom");
+		std::string segment(100, 'x');
+		segment[50] = '+';
+
+		REQUIRE(1 == t.parse_text("hi." + segment).size());
+		REQUIRE("hi.+" == t.parse_text("hi." + segment).begin()->first.get_keyword());
+		REQUIRE("hi.+.bond" == t.parse_text("hi." + segment + ".bond").begin()->first.get_keyword());
+		REQUIRE(1 == t.parse_text("hi." + segment + ".bond").size());
+		REQUIRE(t.parse_text("hi." + segment + ".bonds").empty());
+		REQUIRE(t.parse_text("hi." + segment + "." + segment).empty());
+		REQUIRE("+.mom" == t.parse_text(segment + ".mom").begin()->first.get_keyword());
+		REQUIRE(t.parse_text("hi.").empty());
+	}
+	SECTION("trailing multi level wildcards accept the rest of the text") {
+		ac::trie t;
+		t.insert("hi.#");
+		t.insert("hi.there.#");
+		t.insert("hi.there");
+		t.insert("#");
+		std::string rest(1000, 'z');
+
+		auto emits = t.parse_text("hi.there." + rest);
+		REQUIRE(3 == emits.size());
+		for (const auto& e : emits) {
+			REQUIRE(1008 == e.first.get_end());
+		}
+		REQUIRE(2 == t.parse_text("hi.mom").size());
+		REQUIRE(1 == t.parse_text(rest).size());
+
+		ac::trie::match_context ctx;
+		std::vector<std::string> found;
+		REQUIRE_FALSE(t.parse_text("hi.there." + rest, [&](unsigned index, size_t, size_t end) {
+			REQUIRE(1008 == end);
+			found.push_back(t.get_keyword(index));
+		}, ctx));
+		std::sort(found.begin(), found.end());
+		REQUIRE((std::vector<std::string> { "#", "hi.#", "hi.there.#" }) == found);
+	}
+	SECTION("keywords extended by another keyword still match") {
+		const std::vector<std::vector<std::string>> cases = {
+			{ "a.b", "a.bc", "a.b" },
+			{ "+.b", "+.bc", "a.b" },
+			{ "a.#.b", "a.#.bc", "a.x.b" },
+			{ "a.+", "a.+.c", "a.b" },
+		};
+		for (const auto& c : cases) {
+			INFO(c[0] << " next to " << c[1] << " on " << c[2]);
+			ac::trie t;
+			t.insert(c[0]);
+			t.insert(c[1]);
+			auto emits = t.parse_text(c[2]);
+			REQUIRE(1 == emits.size());
+			REQUIRE(c[0] == emits.begin()->first.get_keyword());
+			REQUIRE(1 == t.freeze().parse_text(c[2]).size());
+		}
+	}
+	SECTION("literal and prefix keywords bypass the wildcard automaton") {
+		const auto keywords = [](const ac::trie::emit_collection& emits) {
+			std::vector<std::string> result;
+			for (const auto& e : emits) {
+				result.push_back(e.first.get_keyword());
+			}
+			std::sort(result.begin(), result.end());
+			return result;
+		};
+		ac::trie t;
+		t.insert("hi.there");
+		t.insert("hi.there");
+		t.insert("hi.#");
+		t.insert("hi.there.#");
+		REQUIRE(1 == t.num_states());
+		t.insert("hi.+.you");
+		REQUIRE(1 < t.num_states());
+
+		auto emits = t.parse_text("hi.there");
+		REQUIRE(3 == emits.size());
+		REQUIRE(keywords(emits) == (std::vector<std::string> { "hi.#", "hi.there", "hi.there" }));
+		REQUIRE(keywords(t.parse_text("hi.there.you")) == (std::vector<std::string> { "hi.#", "hi.+.you", "hi.there.#" }));
+		REQUIRE(t.parse_text("hi.").empty());
+		REQUIRE(t.parse_text("hi").empty());
+		REQUIRE(t.parse_text("").empty());
+
+		ac::trie::match_context ctx;
+		ac::match_result result;
+		REQUIRE(t.first_match("hi.there", result, ctx));
+		REQUIRE(0 == result.start);
+		REQUIRE(7 == result.end);
+		REQUIRE(t.matches_any("hi.x", ctx));
+		REQUIRE_FALSE(t.matches_any("ho.there", ctx));
+
+		auto f = t.freeze();
+		REQUIRE(f.num_keywords() == t.num_keywords());
+		for (const auto& topic : { "hi.there", "hi.there.you", "hi.mom", "hi." }) {
+			INFO(topic);
+			REQUIRE(keywords(t.parse_text(topic)) == keywords(f.parse_text(topic)));
+		}
+	}
+	SECTION("literal and prefix keywords honour case insensitivity") {
+		ac::trie t;
+		t.case_insensitive();
+		t.insert("hi.there");
+		t.insert("hi.#");
+		REQUIRE(2 == t.parse_text("HI.There").size());
+		REQUIRE(1 == t.parse_text("Hi.MOM").size());
+	}
+	SECTION("matches every occurrence found by find") {
+		srand(11);
+		for (int round = 0; round < 20; ++round) {
+			ac::trie t;
+			t.unanchored();
+			std::vector<std::string> keywords;
+			for (int i = 0; i < 30; ++i) {
+				std::string keyword;
+				for (int j = 0, len = 1 + rand() % 4; j < len; ++j) {
+					keyword.append(1, "abc"[rand() % 3]);
+				}
+				keywords.push_back(keyword);
+				t.insert(keyword);
+			}
+			std::string text;
+			for (int j = 0; j < 200; ++j) {
+				text.append(1, "abc"[rand() % 3]);
+			}
+
+			std::vector<std::pair<size_t, unsigned>> expected;
+			for (unsigned index = 0; index < keywords.size(); ++index) {
+				for (size_t pos = text.find(keywords[index]); pos != text.npos; pos = text.find(keywords[index], pos + 1)) {
+					expected.push_back(std::make_pair(pos, index));
+				}
+			}
+			std::sort(expected.begin(), expected.end());
+
+			ac::trie::match_context ctx;
+			const auto& matches = t.match(text, ctx);
+			REQUIRE(expected.size() == matches.size());
+			for (size_t i = 0; i < matches.size(); ++i) {
+				REQUIRE(expected[i].first == matches[i].start);
+				REQUIRE(expected[i].second == matches[i].index);
+				REQUIRE(matches[i].start + keywords[matches[i].index].size() - 1 == matches[i].end);
+			}
+			REQUIRE(t.matches_any(text, ctx) == !expected.empty());
+		}
+	}
+	SECTION("full dfa table is built by build") {
+		ac::trie t;
+		t.unanchored().full_dfa();
+		t.insert("ab");
+		t.insert("b");
+		REQUIRE(0 == t.transition_table_size());
+		t.build();
+		REQUIRE(t.num_states() * 3 * sizeof(std::uint32_t) == t.transition_table_size()); // a, b and the rest
+		REQUIRE(2 == t.parse_text("xab").size());
+	}
+	SECTION("full dfa agrees with the failure walk") {
+		srand(13);
+		for (int round = 0; round < 20; ++round) {
+			ac::trie walk;
+			ac::trie dfa;
+			walk.unanchored();
+			dfa.unanchored().full_dfa();
+			if (round % 2) {
+				walk.case_insensitive();
+				dfa.case_insensitive();
+			}
+			for (int i = 0; i < 30; ++i) {
+				std::string keyword;
+				for (int j = 0, len = 1 + rand() % 4; j < len; ++j) {
+					keyword.append(1, "abc"[rand() % 3]);
+				}
+				walk.insert(keyword);
+				dfa.insert(keyword);
+			}
+			std::string text;
+			for (int j = 0; j < 200; ++j) {
+				text.append(1, "abcABC."[rand() % 7]);
+			}
+
+			ac::trie::match_context walk_ctx;
+			ac::trie::match_context dfa_ctx;
+			const auto& expected = walk.match(text, walk_ctx);
+			const auto& matches = dfa.match(text, dfa_ctx);
+			REQUIRE(dfa.num_states() * 4 * sizeof(std::uint32_t) == dfa.transition_table_size()); // a, b, c and the rest
+			REQUIRE(expected.size() == matches.size());
+			for (size_t i = 0; i < matches.size(); ++i) {
+				REQUIRE(expected[i].index == matches[i].index);
+				REQUIRE(expected[i].start == matches[i].start);
+				REQUIRE(expected[i].end == matches[i].end);
+			}
+			REQUIRE(walk.parse_text(text).size() == dfa.parse_text(text).size());
+		}
+	}
+}